@@ -0,0 +1,256 @@
+// Benchmarks the DLX library on a fixed set of exact cover problems, with
+// each engine in turn. For each problem, reports the time taken to build
+// the matrix, and for each engine the number of solutions, the nodes and
+// updates of dlx_stats(), the search time, the rates, and the peak memory.
+// Each engine runs on each problem in a child process of its own, so peak
+// memory is that of the one engine.
+//
+// Run from the source directory: the 16x16 sudokus are read from 16x16.sud.
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "dlx.h"
+
+#define F(i, n) for(int i=0; i<n; i++)
+
+static double now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Sudoku with BxB boxes: DLX-row (d*N + r)*N + c puts digit d + 1 at row r
+// and column c.
+static int B, N;
+static char **puzzle;
+static int puzzlen;
+
+static dlx_t sudoku() {
+  dlx_t dlx = dlx_new();
+  F(d, N) F(r, N) F(c, N) {
+    int cols[] = {
+      r*N + c, N*N + r*N + d, 2*N*N + c*N + d, 3*N*N + (r/B*B + c/B)*N + d,
+    };
+    dlx_add_row(dlx, cols, 4);
+  }
+  return dlx;
+}
+
+static void pick_givens(dlx_t dlx, int i) {
+  char *s = puzzle[i];
+  F(k, N*N) {
+    int d = s[k] >= 'A' ? s[k] - 'A' + 10 : s[k] - '0';
+    if (s[k] != '.' && d) dlx_pick_row(dlx, (d - 1)*N*N + k);
+  }
+}
+
+// From http://school.maths.uwa.edu.au/~gordon/sudokumin.php
+static char *sudoku17[] = {
+  ".......1.4.........2......."
+    "....5.4.7..8...3....1.9...."
+    "3..4..2...5.1........8.6...",
+  ".......1.4.........2......."
+    "....5.6.4..8...3....1.9...."
+    "3..4..2...5.1........8.7...",
+  ".......12....35......6...7."
+    "7.....3.....4..8..1........"
+    "...12.....8.....4..5....6..",
+};
+
+static dlx_t sudoku9() {
+  B = 3, N = 9;
+  puzzle = sudoku17;
+  puzzlen = sizeof(sudoku17) / sizeof(*sudoku17);
+  return sudoku();
+}
+
+static dlx_t sudoku16() {
+  B = 4, N = 16;
+  FILE *fp = fopen("16x16.sud", "r");
+  if (!fp) return 0;
+  char *line = 0;
+  size_t len = 0;
+  puzzle = 0, puzzlen = 0;
+  while (-1 != getline(&line, &len, fp)) if (strlen(line) >= 256) {
+    puzzle = realloc(puzzle, sizeof(*puzzle) * (puzzlen + 1));
+    puzzle[puzzlen++] = strndup(line, 256);
+  }
+  free(line);
+  fclose(fp);
+  return sudoku();
+}
+
+// N-queens with rows and columns primary, and diagonals secondary.
+static dlx_t queens() {
+  int n = 12;
+  dlx_t dlx = dlx_new();
+  F(r, n) F(c, n) {
+    int cols[] = { r, n + c, 2*n + r + c, 4*n - 1 + r - c + n - 1 };
+    dlx_add_row(dlx, cols, 4);
+  }
+  F(i, 4*n - 2) dlx_mark_optional(dlx, 2*n + i);
+  return dlx;
+}
+
+// Packings of the 12 pentominoes into a 6x10 box. Columns 0 to 11 are the
+// pieces, and the rest are the cells. Keeping the X in the top left quarter
+// leaves one of each set of 4 symmetric packings.
+static dlx_t pentominoes() {
+  enum { W = 10, H = 6 };
+  static const char *piece[12] = {
+    ".##|##.|.#.", "#####", "####|#...", "###.|..##", "##|##|#.",
+    "###|.#.|.#.", "#.#|###", "#..|#..|###", "#..|##.|.##", ".#.|###|.#.",
+    "..#.|####", "##.|.#.|.##",
+  };
+  dlx_t dlx = dlx_new();
+  F(p, 12) {
+    int x[5], y[5], n = 0, seen[8][5];
+    for (int i = 0, r = 0, c = 0; piece[p][i]; i++) {
+      if (piece[p][i] == '|') r++, c = 0;
+      else {
+        if (piece[p][i] == '#') x[n] = c, y[n] = r, n++;
+        c++;
+      }
+    }
+    // The 8 orientations, each shifted to the origin and sorted so that
+    // repeats can be spotted.
+    F(o, 8) {
+      int *s = seen[o], mx = 99, my = 99, u[5], v[5];
+      F(i, 5) {
+        u[i] = o & 1 ? -x[i] : x[i];
+        v[i] = o & 2 ? -y[i] : y[i];
+        if (o & 4) { int t = u[i]; u[i] = v[i], v[i] = t; }
+        if (mx > u[i]) mx = u[i];
+        if (my > v[i]) my = v[i];
+      }
+      F(i, 5) s[i] = (v[i] - my)*W + u[i] - mx;
+      F(i, 5) F(j, 4 - i) if (s[j] > s[j + 1]) {
+        int t = s[j]; s[j] = s[j + 1], s[j + 1] = t;
+      }
+      int repeat = 0;
+      F(e, o) repeat |= !memcmp(seen[e], s, sizeof(int) * 5);
+      if (repeat) continue;
+      F(r, H) F(c, W) {
+        int cols[6] = { p }, fits = 1;
+        F(i, 5) {
+          int cr = r + s[i]/W, cc = c + s[i]%W;
+          fits &= cr < H && cc < W;
+          cols[i + 1] = 12 + cr*W + cc;
+        }
+        if (p == 9 && (2*(r + 1) >= H || 2*(c + 1) >= W)) fits = 0;
+        if (fits) dlx_add_row(dlx, cols, 6);
+      }
+    }
+  }
+  return dlx;
+}
+
+// Langford pairs: the numbers 1 to n each appear twice in a sequence, and
+// the two k's have k numbers between them. Column k - 1 is the number k,
+// and column n + i is position i.
+static dlx_t langford() {
+  int n = 11;
+  dlx_t dlx = dlx_new();
+  for (int k = 1; k <= n; k++) F(i, 2*n - k - 1) {
+    int cols[] = { k - 1, n + i, n + i + k + 1 };
+    dlx_add_row(dlx, cols, 3);
+  }
+  return dlx;
+}
+
+static struct {
+  const char *name;
+  dlx_t (*build)();
+  int sudoku;  // Whether to solve each of the puzzles, rather than the matrix.
+  int rounds;  // Times to repeat the search, so that it takes measurable time.
+} problem[] = {
+  { "17-clue sudokus", sudoku9, 1, 1000 },
+  { "16x16 sudokus", sudoku16, 1, 1 },
+  { "12 queens", queens, 0, 1 },
+  { "6x10 pentominoes", pentominoes, 0, 1 },
+  { "Langford pairs, n = 11", langford, 0, 1 },
+};
+
+static struct {
+  const char *name;
+  int engine, heuristic, threads;  // No threads: count with a ZDD.
+  int cache;  // MiB for dlx_set_cache().
+} engine[] = {
+  { "recursive", DLX_RECURSIVE, DLX_MRV, 1, 0 },
+  { "iterative", DLX_ITERATIVE, DLX_MRV, 1, 0 },
+  { "buckets", DLX_RECURSIVE, DLX_BUCKETS, 1, 0 },
+  { "cached", DLX_RECURSIVE, DLX_MRV, 1, 64 },
+  { "parallel x4", DLX_RECURSIVE, DLX_MRV, 4, 0 },
+  { "zdd", DLX_RECURSIVE, DLX_MRV, 0, 0 },
+};
+
+// Builds problem k and searches it with engine e, printing the header of
+// the problem along with the first engine. Counts are totals over all
+// puzzles and rounds. Returns 0 if the problem is unavailable.
+static int run(int k, int e) {
+  double t = now();
+  dlx_t dlx = problem[k].build();
+  t = now() - t;
+  if (!dlx) {
+    printf("%s: skipped\n", problem[k].name);
+    return 0;
+  }
+  if (!e) printf("%s: %d rows, %d columns, built in %.3fs\n",
+                 problem[k].name, dlx_rows(dlx), dlx_cols(dlx), t);
+  dlx_set_engine(dlx, engine[e].engine);
+  dlx_set_heuristic(dlx, engine[e].heuristic);
+  dlx_set_cache(dlx, (int64_t) engine[e].cache << 20);
+  int64_t solutions = 0, nodes = 0, updates = 0;
+  double seconds = 0;
+  int n = problem[k].sudoku ? puzzlen : 1;
+  F(i, n * problem[k].rounds) {
+    if (problem[k].sudoku) pick_givens(dlx, i % n);
+    t = now();
+    if (!engine[e].threads) {
+      dlx_zdd_t zdd = dlx_zdd(dlx);
+      solutions += dlx_zdd_count(zdd);
+      dlx_zdd_clear(zdd);
+    } else if (engine[e].threads > 1) {
+      solutions += dlx_forall_cover_parallel(dlx, engine[e].threads, 0);
+    } else {
+      solutions += dlx_count_covers(dlx, 0);
+    }
+    seconds += now() - t;
+    nodes += dlx_stats(dlx)->nodes;
+    updates += dlx_stats(dlx)->updates;
+    dlx_reset(dlx);
+  }
+  printf("  %-12s %9lld solutions %12lld nodes %13lld updates %8.3fs"
+         " %7.2fM nodes/s %7.2fM updates/s", engine[e].name,
+         (long long) solutions, (long long) nodes, (long long) updates,
+         seconds, nodes / seconds / 1e6, updates / seconds / 1e6);
+  dlx_clear(dlx);
+  return 1;
+}
+
+int main() {
+  F(k, sizeof(problem) / sizeof(*problem)) {
+    F(e, sizeof(engine) / sizeof(*engine)) {
+      fflush(stdout);
+      pid_t pid = fork();
+      if (!pid) {
+        int ok = run(k, e);
+        fflush(stdout);
+        _exit(!ok);
+      }
+      struct rusage ru;
+      int status;
+      wait4(pid, &status, 0, &ru);
+      if (!WIFEXITED(status) || WEXITSTATUS(status)) break;
+      printf(" %8ld KiB\n", ru.ru_maxrss);
+    }
+  }
+  return 0;
+}
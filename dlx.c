@@ -1,127 +1,217 @@
 // See http://en.wikipedia.org/wiki/Dancing_Links.
+#include <fcntl.h>
 #include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 #include "dlx.h"
 
 #define F(i,n) for(int i = 0; i < n; i++)
 
-#define C(i,n,dir) for(cell_ptr i = (n)->dir; i != n; i = i->dir)
+// Cells live in a single arena owned by the instance, as in Knuth's DLX1, and
+// refer to each other by index rather than by pointer. Index 0 is the root.
+// Loops over links expect the arena in a variable named 'a'.
+#define C(i,n,dir) for(int i = a[n].dir; i != (n); i = a[i].dir)
+
+// Search statistics cost a few increments per node; building with
+// -DDLX_NO_STATS compiles them out. Searches expect the statistics in a
+// variable named 'st'.
+#ifdef DLX_NO_STATS
+#define STAT(...)
+#else
+#define STAT(...) __VA_ARGS__
+#endif
 
-struct cell_s;
-typedef struct cell_s *cell_ptr;
 struct cell_s {
-  cell_ptr U, D, L, R;
+  int U, D, L, R;
   int n;
   union {
-    cell_ptr c;
+    int c;
     int s;
   };
+  // Color of a cell in a secondary column, or 0. Set to -1 while the column
+  // is purified to the cell's color, as the cell then needs no more work.
+  // For a column header, the color it is purified to, if any.
+  int color;
 };
+typedef struct cell_s *cell_ptr;
 
 // Some link dance moves.
-static cell_ptr LR_self(cell_ptr c) { return c->L = c->R = c; }
-static cell_ptr UD_self(cell_ptr c) { return c->U = c->D = c; }
+static int LR_self(cell_ptr a, int c) { return a[c].L = a[c].R = c; }
+static int UD_self(cell_ptr a, int c) { return a[c].U = a[c].D = c; }
 
 // Undeletable deletes.
-static cell_ptr LR_delete(cell_ptr c) {
-  return c->L->R = c->R, c->R->L = c->L, c;
+static int LR_delete(cell_ptr a, int c) {
+  return a[a[c].L].R = a[c].R, a[a[c].R].L = a[c].L, c;
 }
-static cell_ptr UD_delete(cell_ptr c) {
-  return c->U->D = c->D, c->D->U = c->U, c;
+static int UD_delete(cell_ptr a, int c) {
+  return a[a[c].U].D = a[c].D, a[a[c].D].U = a[c].U, c;
 }
 
 // Undelete.
-static cell_ptr UD_restore(cell_ptr c) { return c->U->D = c->D->U = c; }
-static cell_ptr LR_restore(cell_ptr c) { return c->L->R = c->R->L = c; }
+static int UD_restore(cell_ptr a, int c) {
+  return a[a[c].U].D = a[a[c].D].U = c;
+}
+static int LR_restore(cell_ptr a, int c) {
+  return a[a[c].L].R = a[a[c].R].L = c;
+}
 
 // Insert cell j to the left of cell k.
-static cell_ptr LR_insert(cell_ptr j, cell_ptr k) {
-  return j->L = k->L, j->R = k, k->L = k->L->R = j;
+static int LR_insert(cell_ptr a, int j, int k) {
+  return a[j].L = a[k].L, a[j].R = k, a[a[k].L].R = j, a[k].L = j;
 }
 
 // Insert cell j above cell k.
-static cell_ptr UD_insert (cell_ptr j, cell_ptr k) {
-  return j->U = k->U, j->D = k, k->U = k->U->D = j;
-}
-
-cell_ptr col_new() {
-  cell_ptr c = malloc(sizeof(*c));
-  UD_self(c)->s = 0;
-  return c;
+static int UD_insert(cell_ptr a, int j, int k) {
+  return a[j].U = a[k].U, a[j].D = k, a[a[k].U].D = j, a[k].U = j;
 }
 
 struct dlx_s {
   int ctabn, rtabn, ctab_alloc, rtab_alloc;
-  cell_ptr *ctab, *rtab;
-  cell_ptr root;
+  // Arena indices of column headers, and of the first cell of each row
+  // (0 for an empty row).
+  int *ctab, *rtab;
+  // How many rows of a solution may have a 1 in each column, from lo to hi.
+  // Both are 1 unless set by dlx_set_bounds(), which also sets 'bounded'.
+  int *lo, *hi, bounded;
+  // Column choice: one of the DLX_MRV family, with the weights of columns
+  // for DLX_MRV_WEIGHT, the state of the generator for DLX_RANDOM, and the
+  // callback for DLX_SCORE.
+  int heuristic, *weight;
+  uint64_t rng;
+  int (*score)(int, int);
+  int celln, cell_alloc;
+  cell_ptr cell;
+  int engine;
+  // Progress hook of solve(), called every 'progress_every'
+  // nodes.
+  void (*progress_cb)(double);
+  int64_t progress_every;
+  // Memory for the cache of dlx_count_covers(), in bytes; 0 for none.
+  int64_t cache_bytes;
+  // Rows picked (as their first cell) and removed (as the negated first cell)
+  // so far, in order, so they can be undone.
+  int *trail, trailn, trail_alloc;
+  struct dlx_stats_s stats;  // Of the last search.
 };
 typedef struct dlx_s *dlx_t;
 
+// Returns the index of a fresh cell. May move the arena.
+static int cell_new(dlx_t p) {
+  if (p->celln == p->cell_alloc) {
+    p->cell = realloc(p->cell, sizeof(*p->cell) * (p->cell_alloc *= 2));
+  }
+  p->cell[p->celln].color = 0;
+  return p->celln++;
+}
+
+// Makes room for n more cells at once.
+static void cell_reserve(dlx_t p, int n) {
+  if (p->celln + n <= p->cell_alloc) return;
+  while (p->celln + n > p->cell_alloc) p->cell_alloc *= 2;
+  p->cell = realloc(p->cell, sizeof(*p->cell) * p->cell_alloc);
+}
+
 dlx_t dlx_new() {
   dlx_t p = malloc(sizeof(*p));
   p->ctabn = p->rtabn = 0;
   p->ctab_alloc = p->rtab_alloc = 8;
-  p->ctab = malloc(sizeof(cell_ptr) * p->ctab_alloc);
-  p->rtab = malloc(sizeof(cell_ptr) * p->rtab_alloc);
-  p->root = LR_self(col_new());
+  p->ctab = malloc(sizeof(int) * p->ctab_alloc);
+  p->lo = malloc(sizeof(int) * p->ctab_alloc);
+  p->hi = malloc(sizeof(int) * p->ctab_alloc);
+  p->bounded = 0;
+  p->heuristic = DLX_MRV;
+  p->weight = malloc(sizeof(int) * p->ctab_alloc);
+  dlx_set_seed(p, 0);
+  p->score = 0;
+  p->rtab = malloc(sizeof(int) * p->rtab_alloc);
+  p->celln = 0;
+  p->cell_alloc = 64;
+  p->cell = malloc(sizeof(*p->cell) * p->cell_alloc);
+  p->engine = DLX_RECURSIVE;
+  p->progress_cb = 0;
+  p->progress_every = 0;
+  p->cache_bytes = 0;
+  p->trailn = 0;
+  p->trail_alloc = 8;
+  p->trail = malloc(sizeof(int) * p->trail_alloc);
+  memset(&p->stats, 0, sizeof(p->stats));
+  int root = cell_new(p);
+  LR_self(p->cell, root);
+  UD_self(p->cell, root);
   return p;
 }
 
-void free_row(cell_ptr r) {
-  cell_ptr next;
-  for(cell_ptr j = r->R; j != r; j = next) {
-    next = j->R;
-    free(j);
-  }
-  free(r);
-}
-
 void dlx_clear(dlx_t p) {
-  // Elements in the LR list for each row are never covered, thus all cells
-  // can be accessed from the 'rtab' LR lists.
-  F(i, p->rtabn) {
-    cell_ptr r = p->rtab[i];
-    if (r) free_row(r);
-  }
-  // Columns may be covered, but they are always accessible from 'ctab'.
-  F(i, p->ctabn) free(p->ctab[i]);
+  // Every cell, including those of removed rows, lives in the arena.
+  free(p->cell);
+  free(p->trail);
+  free(p->stats.profile);
   free(p->rtab);
   free(p->ctab);
-  free(p->root);
+  free(p->lo);
+  free(p->hi);
+  free(p->weight);
   free(p);
 }
 
+void dlx_empty(dlx_t p) {
+  p->ctabn = p->rtabn = p->celln = p->trailn = 0;
+  p->bounded = 0;
+  int root = cell_new(p);
+  LR_self(p->cell, root);
+  UD_self(p->cell, root);
+}
+
 int dlx_rows(dlx_t dlx) { return dlx->rtabn; }
 int dlx_cols(dlx_t dlx) { return dlx->ctabn; }
 
-void dlx_add_col(dlx_t p) {
-  cell_ptr c = col_new();
-  LR_insert(c, p->root);
-  c->n = p->ctabn++;
+static void add_col(dlx_t p) {
+  int c = cell_new(p);
+  cell_ptr a = p->cell;
+  UD_self(a, c);
+  a[c].s = 0;
+  LR_insert(a, c, 0);
+  a[c].n = p->ctabn++;
   if (p->ctabn == p->ctab_alloc) {
-    p->ctab = realloc(p->ctab, sizeof(cell_ptr) * (p->ctab_alloc *= 2));
+    p->ctab_alloc *= 2;
+    p->ctab = realloc(p->ctab, sizeof(int) * p->ctab_alloc);
+    p->lo = realloc(p->lo, sizeof(int) * p->ctab_alloc);
+    p->hi = realloc(p->hi, sizeof(int) * p->ctab_alloc);
+    p->weight = realloc(p->weight, sizeof(int) * p->ctab_alloc);
   }
-  p->ctab[c->n] = c;
+  p->ctab[a[c].n] = c;
+  p->lo[a[c].n] = p->hi[a[c].n] = 1;
+  p->weight[a[c].n] = 0;
 }
 
-void dlx_add_row(dlx_t p) {
+static void add_empty_row(dlx_t p) {
   if (p->rtabn == p->rtab_alloc) {
-    p->rtab = realloc(p->rtab, sizeof(cell_ptr) * (p->rtab_alloc *= 2));
+    p->rtab = realloc(p->rtab, sizeof(int) * (p->rtab_alloc *= 2));
   }
   p->rtab[p->rtabn++] = 0;
 }
 
-static void alloc_col(dlx_t p, int n) { while(p->ctabn <= n) dlx_add_col(p); }
-static void alloc_row(dlx_t p, int n) { while(p->rtabn <= n) dlx_add_row(p); }
+static void alloc_col(dlx_t p, int n) { while(p->ctabn <= n) add_col(p); }
+static void alloc_row(dlx_t p, int n) { while(p->rtabn <= n) add_empty_row(p); }
 
 void dlx_mark_optional(dlx_t p, int col) {
   alloc_col(p, col);
-  cell_ptr c = p->ctab[col];
+  cell_ptr a = p->cell;
+  int c = p->ctab[col];
   // Prevent undeletion by self-linking.
-  LR_self(LR_delete(c));
+  LR_self(a, LR_delete(a, c));
 }
 
-void dlx_set(dlx_t p, int row, int col) {
+// Returns the arena index of the cell at the given row and column, creating
+// it if need be.
+static int cell_set(dlx_t p, int row, int col) {
   // We don't bother sorting. DLX works fine with jumbled rows and columns.
   // We just have to watch out for duplicates. (Actually, I think the DLX code
   // works even with duplicates, though it would be inefficient.)
@@ -130,93 +220,1411 @@ void dlx_set(dlx_t p, int row, int col) {
   // is called, not by row number. Similarly for a given row and its LR list.
   alloc_row(p, row);
   alloc_col(p, col);
-  cell_ptr c = p->ctab[col];
-  cell_ptr new1() {
-    cell_ptr n = malloc(sizeof(*n));
-    n->n = row;
-    n->c = c;
-    c->s++;
-    UD_insert(n, c);
-    return n;
+  int c = p->ctab[col];
+  int *rp = p->rtab + row;
+  cell_ptr a = p->cell;
+  if (*rp) {
+    // Ignore duplicates.
+    if (a[*rp].c == c) return *rp;
+    C(r, *rp, R) if (a[r].c == c) return r;
+  }
+  int n = cell_new(p);
+  a = p->cell;
+  a[n].n = row;
+  a[n].c = c;
+  a[c].s++;
+  UD_insert(a, n, c);
+  // Start the LR list, or insert at its end.
+  if (!*rp) *rp = LR_self(a, n); else LR_insert(a, n, *rp);
+  return n;
+}
+
+void dlx_set(dlx_t p, int row, int col) { cell_set(p, row, col); }
+
+// Links the cells of a new, empty row, in one pass. The columns must exist
+// and there must be room in the arena. A repeated column is caught by its
+// last cell, which then belongs to this row.
+static void link_row(dlx_t p, int row, const int *cols, int n) {
+  cell_ptr a = p->cell;
+  int *rp = p->rtab + row;
+  F(i, n) {
+    int c = p->ctab[cols[i]];
+    if (a[c].U != c && a[a[c].U].n == row) continue;
+    int x = p->celln++;
+    a[x].n = row;
+    a[x].c = c;
+    a[x].color = 0;
+    a[c].s++;
+    UD_insert(a, x, c);
+    if (!*rp) *rp = LR_self(a, x); else LR_insert(a, x, *rp);
   }
-  cell_ptr *rp = p->rtab + row;
-  if (!*rp) {
-    *rp = LR_self(new1());
-    return;
+}
+
+int dlx_add_row(dlx_t p, const int *cols, int n) {
+  int max = -1;
+  F(i, n) {
+    if (cols[i] < 0) return -1;
+    if (max < cols[i]) max = cols[i];
+  }
+  alloc_col(p, max);
+  alloc_row(p, p->rtabn);
+  cell_reserve(p, n);
+  link_row(p, p->rtabn - 1, cols, n);
+  return p->rtabn - 1;
+}
+
+dlx_t dlx_from_csr(int nrows, int ncols, const int *row_ptr,
+                   const int *col_idx) {
+  F(i, row_ptr[nrows]) if (col_idx[i] < 0) return 0;
+  F(i, row_ptr[nrows]) if (ncols <= col_idx[i]) ncols = col_idx[i] + 1;
+  dlx_t p = dlx_new();
+  alloc_col(p, ncols - 1);
+  alloc_row(p, nrows - 1);
+  cell_reserve(p, row_ptr[nrows]);
+  F(r, nrows) {
+    link_row(p, r, col_idx + row_ptr[r], row_ptr[r + 1] - row_ptr[r]);
   }
-  // Ignore duplicates.
-  if ((*rp)->c->n == col) return;
-  C(r, *rp, R) if (r->c->n == col) return;
-  // Otherwise insert at end of LR list.
-  LR_insert(new1(), *rp);
+  return p;
 }
 
-static void cover_col(cell_ptr c) {
-  LR_delete(c);
-  C(i, c, D) C(j, i, R) UD_delete(j)->c->s--;
+int dlx_set_bounds(dlx_t p, int col, int lo, int hi) {
+  if (col < 0 || lo < 0 || hi < 1 || lo > hi) return -1;
+  alloc_col(p, col);
+  p->lo[col] = lo;
+  p->hi[col] = hi;
+  p->bounded = 1;
+  return 0;
 }
 
-static void uncover_col(cell_ptr c) {
-  C(i, c, U) C(j, i, L) UD_restore(j)->c->s++;
-  LR_restore(c);
+void dlx_set_color(dlx_t p, int row, int col, int color) {
+  if (color < 0) color = 0;
+  dlx_mark_optional(p, col);
+  int n = cell_set(p, row, col);
+  p->cell[n].color = color;
+}
+
+// Removes the other cells of the row of cell x from their columns, except
+// those in columns purified to their color. Returns the number of links
+// removed, for the statistics.
+//
+// During some searches, active columns are also kept in buckets by size so
+// the smallest is found without a scan. The buckets live at the end of the
+// arena: the root's U field is the index of the first of a node per column
+// number, and its D field the index of the first of the list heads, one per
+// size. A node links to its column with c, and its bucket with L and R. Its
+// D field is 1 while it is in a bucket, 2 while its column is covered, and 0
+// for columns that are never active. No buckets if the root's U field is 0.
+
+// Moves column c to the bucket of its current size.
+static void rebucket(cell_ptr a, int c) {
+  int x = a[0].U + a[c].n;
+  if (a[x].D != 1) return;
+  LR_delete(a, x);
+  LR_insert(a, x, a[0].D + a[c].s);
+}
+
+static int hide(cell_ptr a, int x) {
+  int n = 0;
+  C(j, x, R) if (a[j].color >= 0) {
+    int c = a[UD_delete(a, j)].c;
+    a[c].s--, n++;
+    if (a[0].U) rebucket(a, c);
+  }
+  return n;
+}
+
+static void unhide(cell_ptr a, int x) {
+  C(j, x, L) if (a[j].color >= 0) {
+    int c = a[UD_restore(a, j)].c;
+    a[c].s++;
+    if (a[0].U) rebucket(a, c);
+  }
+}
+
+static int cover_col(cell_ptr a, int c) {
+  int n = 1;
+  LR_delete(a, c);
+  int x = a[0].U + a[c].n;
+  if (a[0].U && a[x].D == 1) a[LR_delete(a, x)].D = 2;
+  C(i, c, D) n += hide(a, i);
+  return n;
+}
+
+static void uncover_col(cell_ptr a, int c) {
+  C(i, c, U) unhide(a, i);
+  LR_restore(a, c);
+  int x = a[0].U + a[c].n;
+  if (a[0].U && a[x].D == 2) {
+    a[x].D = 1;
+    LR_insert(a, x, a[0].D + a[c].s);
+  }
+}
+
+// Knuth's purify: keeps only the rows that agree with the color of cell x in
+// its column. The others are hidden, and the rest are marked as done.
+static int purify(cell_ptr a, int x) {
+  int n = 0, c = a[x].c;
+  a[c].color = a[x].color;
+  C(i, c, D) if (i != x) {
+    if (a[i].color == a[x].color) a[i].color = -1; else n += hide(a, i);
+  }
+  return n;
+}
+
+static void unpurify(cell_ptr a, int x) {
+  int c = a[x].c;
+  C(i, c, U) if (i != x) {
+    if (a[i].color < 0) a[i].color = a[x].color; else unhide(a, i);
+  }
+  a[c].color = 0;
+}
+
+// Commits to the column of cell x, once its row is chosen: covers it, or
+// purifies it if the cell is colored. Nothing is left to do if the column
+// is already purified to the same color.
+static int commit(cell_ptr a, int x) {
+  if (!a[x].color) return cover_col(a, a[x].c);
+  if (a[x].color > 0) return purify(a, x);
+  return 0;
+}
+
+static void uncommit(cell_ptr a, int x) {
+  if (!a[x].color) uncover_col(a, a[x].c);
+  else if (a[x].color > 0) unpurify(a, x);
+}
+
+// Choosing the row at arena index x as the search does: commit to its
+// column, then the rest of its columns.
+static void choose_row(cell_ptr a, int x) {
+  commit(a, x);
+  C(j, x, R) commit(a, j);
+}
+
+static void unchoose_row(cell_ptr a, int x) {
+  C(j, x, L) uncommit(a, j);
+  uncommit(a, x);
+}
+
+static void trail_push(dlx_t p, int x) {
+  if (p->trailn == p->trail_alloc) {
+    p->trail = realloc(p->trail, sizeof(int) * (p->trail_alloc *= 2));
+  }
+  p->trail[p->trailn++] = x;
 }
 
 int dlx_pick_row(dlx_t p, int i) {
   if (i < 0 || i >= p->rtabn) return -1;
-  cell_ptr r = p->rtab[i];
+  cell_ptr a = p->cell;
+  int r = p->rtab[i];
   if (!r) return 0;  // Empty row.
-  cover_col(r->c);
-  C(j, r, R) cover_col(j->c);
+  // Refuse rows that clash with rows already picked. Such a row has been
+  // unlinked from some of its columns, or lies in a covered column.
+  // (Covered optional columns are indistinguishable from uncovered ones, but
+  // only matter for rows with a single cell.) Or a cell of the row has the
+  // wrong color for a purified column.
+  int clash(int x) {
+    int c = a[x].c;
+    return a[a[x].U].D != x || a[a[c].L].R != c ||
+        (a[x].color >= 0 && a[c].color && a[c].color != a[x].color);
+  }
+  if (clash(r)) return -1;
+  C(j, r, R) if (clash(j)) return -1;
+  choose_row(a, r);
+  trail_push(p, r);
   return 0;
 }
 
 int dlx_remove_row(dlx_t p, int i) {
   if (i < 0 || i >= p->rtabn) return -1;
-  cell_ptr r = p->rtab[i];
+  cell_ptr a = p->cell;
+  int r = p->rtab[i];
   if (!r) return 0;  // Empty row.
-  UD_delete(r)->c->s--;
-  C(j, r, R){
-    UD_delete(j)->c->s--;
+  a[a[UD_delete(a, r)].c].s--;
+  C(j, r, R) {
+    a[a[UD_delete(a, j)].c].s--;
   }
+  // The cells stay in the arena until dlx_clear(), so the row can be restored.
   p->rtab[i] = 0;
-  free_row(r);
+  trail_push(p, -r);
+  return 0;
+}
+
+int dlx_mark(dlx_t p) { return p->trailn; }
+
+void dlx_undo(dlx_t p, int mark) {
+  cell_ptr a = p->cell;
+  while (p->trailn > mark) {
+    int r = p->trail[--p->trailn];
+    if (r > 0) {
+      unchoose_row(a, r);
+      continue;
+    }
+    r = -r;
+    C(j, r, L) a[a[UD_restore(a, j)].c].s++;
+    a[a[UD_restore(a, r)].c].s++;
+    p->rtab[a[r].n] = r;
+  }
+}
+
+void dlx_reset(dlx_t p) { dlx_undo(p, 0); }
+
+dlx_t dlx_clone(dlx_t p) {
+  dlx_t q = malloc(sizeof(*q));
+  *q = *p;
+  q->ctab = malloc(sizeof(int) * q->ctab_alloc);
+  memcpy(q->ctab, p->ctab, sizeof(int) * p->ctabn);
+  q->lo = malloc(sizeof(int) * q->ctab_alloc);
+  memcpy(q->lo, p->lo, sizeof(int) * p->ctabn);
+  q->hi = malloc(sizeof(int) * q->ctab_alloc);
+  memcpy(q->hi, p->hi, sizeof(int) * p->ctabn);
+  q->weight = malloc(sizeof(int) * q->ctab_alloc);
+  memcpy(q->weight, p->weight, sizeof(int) * p->ctabn);
+  q->rtab = malloc(sizeof(int) * q->rtab_alloc);
+  memcpy(q->rtab, p->rtab, sizeof(int) * p->rtabn);
+  q->cell = malloc(sizeof(*q->cell) * q->cell_alloc);
+  memcpy(q->cell, p->cell, sizeof(*q->cell) * p->celln);
+  q->trail = malloc(sizeof(int) * q->trail_alloc);
+  memcpy(q->trail, p->trail, sizeof(int) * p->trailn);
+  memset(&q->stats, 0, sizeof(q->stats));
+  return q;
+}
+
+// Binary format: the magic string, then 32-bit ints in native byte order:
+//
+//   nrows, ncols, ncells, trailn
+//   optional[ncols], lo[ncols], hi[ncols]
+//   row_ptr[nrows + 1], col_idx[ncells], color[ncells]
+//   trail[trailn]
+//
+// The rows are in compressed sparse row form, as for dlx_from_csr(). The
+// trail lists picked rows as their number r, and removed rows as -r - 1.
+static const char dlx_magic[8] = "DLXBIN1";
+
+int dlx_save(dlx_t p, const char *filename) {
+  FILE *fp = fopen(filename, "wb");
+  if (!fp) return -1;
+  // A copy with every row restored shows the matrix as it was built.
+  dlx_t q = dlx_clone(p);
+  dlx_reset(q);
+  cell_ptr a = q->cell;
+  int ncells = 0;
+  F(r, q->rtabn) if (q->rtab[r]) {
+    ncells++;
+    C(j, q->rtab[r], R) ncells++;
+  }
+  int32_t head[] = { q->rtabn, q->ctabn, ncells, p->trailn };
+  int32_t *buf = malloc(sizeof(int32_t) * (3*q->ctabn + q->rtabn + 1 +
+                                           2*ncells + p->trailn));
+  int32_t *w = buf;
+  F(n, q->ctabn) {
+    int c = q->ctab[n];
+    *w++ = a[c].L == c && a[c].R == c;
+  }
+  F(n, q->ctabn) *w++ = q->lo[n];
+  F(n, q->ctabn) *w++ = q->hi[n];
+  int32_t *row_ptr = w, *col_idx = w + q->rtabn + 1, *color = col_idx + ncells;
+  int k = 0;
+  void put(int x) {
+    color[k] = a[x].color;
+    col_idx[k++] = a[a[x].c].n;
+  }
+  F(r, q->rtabn) {
+    row_ptr[r] = k;
+    if (!q->rtab[r]) continue;
+    put(q->rtab[r]);
+    C(j, q->rtab[r], R) put(j);
+  }
+  row_ptr[q->rtabn] = k;
+  w = color + ncells;
+  F(i, p->trailn) {
+    int t = p->trail[i];
+    *w++ = t > 0 ? a[t].n : -a[-t].n - 1;
+  }
+  int ok = fwrite(dlx_magic, sizeof(dlx_magic), 1, fp) == 1 &&
+           fwrite(head, sizeof(head), 1, fp) == 1 &&
+           fwrite(buf, sizeof(int32_t), w - buf, fp) == (size_t) (w - buf);
+  free(buf);
+  dlx_clear(q);
+  if (fclose(fp) || !ok) return -1;
   return 0;
 }
 
+dlx_t dlx_load(const char *filename) {
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) return 0;
+  struct stat sb;
+  void *map = MAP_FAILED;
+  if (!fstat(fd, &sb) && sb.st_size >= 8 + 4 * (off_t) sizeof(int32_t)) {
+    map = mmap(0, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (map == MAP_FAILED) return 0;
+  dlx_t p = 0;
+  const int32_t *head = (const int32_t *) ((const char *) map + 8);
+  int nrows = head[0], ncols = head[1], ncells = head[2], trailn = head[3];
+  const int32_t *optional = head + 4, *lo = optional + ncols, *hi = lo + ncols;
+  const int32_t *row_ptr = hi + ncols, *col_idx = row_ptr + nrows + 1;
+  const int32_t *color = col_idx + ncells, *trail = color + ncells;
+  // Check everything before trusting it.
+  int ok(void) {
+    if (memcmp(map, dlx_magic, 8) || nrows < 0 || ncols < 0 || ncells < 0 ||
+        trailn < 0 || sb.st_size != 8 + (off_t) sizeof(int32_t) *
+        (4 + 3 * (off_t) ncols + nrows + 1 + 2 * (off_t) ncells + trailn)) {
+      return 0;
+    }
+    if (row_ptr[0] || row_ptr[nrows] != ncells) return 0;
+    F(r, nrows) if (row_ptr[r] > row_ptr[r + 1]) return 0;
+    // Colors only go in optional columns.
+    F(i, ncells) if (col_idx[i] < 0 || col_idx[i] >= ncols || color[i] < 0 ||
+                     (color[i] && !optional[col_idx[i]])) {
+      return 0;
+    }
+    F(n, ncols) if (lo[n] < 0 || hi[n] < 1 || lo[n] > hi[n]) return 0;
+    F(i, trailn) if (trail[i] >= nrows || trail[i] < -nrows) return 0;
+    return 1;
+  }
+  if (ok()) {
+    p = dlx_from_csr(nrows, ncols, row_ptr, col_idx);
+    cell_ptr a = p->cell;
+    F(r, nrows) if (p->rtab[r]) {
+      // Cells are linked in the order given.
+      int x = p->rtab[r];
+      for (int i = row_ptr[r]; i < row_ptr[r + 1]; i++, x = a[x].R) {
+        a[x].color = color[i];
+      }
+    }
+    F(n, ncols) {
+      if (optional[n]) dlx_mark_optional(p, n);
+      if (lo[n] != 1 || hi[n] != 1) dlx_set_bounds(p, n, lo[n], hi[n]);
+    }
+    // A trail that cannot be replayed, such as one picking clashing rows,
+    // is refused.
+    F(i, trailn) if (trail[i] >= 0 ? dlx_pick_row(p, trail[i])
+                                   : dlx_remove_row(p, -trail[i] - 1)) {
+      dlx_clear(p);
+      p = 0;
+      break;
+    }
+  }
+  munmap(map, sb.st_size);
+  return p;
+}
+
+#ifndef DLX_NO_STATS
+static double now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Counts a node of the search tree at depth l.
+static void visit(struct dlx_stats_s *st, int l) {
+  st->nodes++;
+  st->profile[l]++;
+  if (st->max_depth < l) st->max_depth = l;
+}
+
+// Adds the counts of a search of a subtree rooted at depth l.
+static void stats_add(struct dlx_stats_s *st, struct dlx_stats_s *sub, int l) {
+  if (!sub->nodes) return;
+  st->nodes += sub->nodes;
+  st->updates += sub->updates;
+  st->solutions += sub->solutions;
+  if (st->max_depth < l + sub->max_depth) st->max_depth = l + sub->max_depth;
+  F(i, sub->max_depth + 1) st->profile[l + i] += sub->profile[i];
+}
+#endif
+
+// Zeroes the statistics for a new search. The search tree is at most one
+// level deeper than there are columns, or with bounds, than there are
+// columns and rows: each level chooses a row or finishes with a column.
+static struct dlx_stats_s *stats_start(dlx_t p) {
+  struct dlx_stats_s *st = &p->stats;
+  int depth = p->ctabn + 1 + (p->bounded ? p->rtabn : 0);
+  int64_t *profile = realloc(st->profile, sizeof(int64_t) * depth);
+  memset(st, 0, sizeof(*st));
+  memset(profile, 0, sizeof(int64_t) * depth);
+  st->profile = profile;
+  STAT(st->seconds = -now());
+  return st;
+}
+
+static void stats_stop(struct dlx_stats_s *st) {
+  STAT(st->seconds += now());
+}
+
+struct dlx_stats_s *dlx_stats(dlx_t p) { return &p->stats; }
+
+void dlx_set_heuristic(dlx_t p, int heuristic) { p->heuristic = heuristic; }
+
+void dlx_set_weight(dlx_t p, int col, int weight) {
+  alloc_col(p, col);
+  p->weight[col] = weight;
+}
+
+void dlx_set_seed(dlx_t p, unsigned seed) {
+  p->rng = seed + 0x9e3779b97f4a7c15;
+}
+
+void dlx_set_score(dlx_t p, int (*score)(int col, int size)) {
+  p->heuristic = DLX_SCORE;
+  p->score = score;
+}
+
+// Xorshift.
+static int rnd(dlx_t p, int n) {
+  p->rng ^= p->rng << 13;
+  p->rng ^= p->rng >> 7;
+  p->rng ^= p->rng << 17;
+  return p->rng % n;
+}
+
+// Puts the active columns in buckets by size, for DLX_BUCKETS. The arena
+// grows, so any pointers to it must be refreshed.
+static void buckets_start(dlx_t p) {
+  if (p->heuristic != DLX_BUCKETS || p->bounded) return;
+  cell_ptr a = p->cell;
+  int max = 0, base = p->celln;
+  C(i, 0, R) if (max < a[i].s) max = a[i].s;
+  F(i, p->ctabn + max + 1) cell_new(p);
+  a = p->cell;
+  a[0].U = base;
+  a[0].D = base + p->ctabn;
+  F(k, max + 1) LR_self(a, a[0].D + k);
+  F(n, p->ctabn) a[base + n].D = 0;
+  C(i, 0, R) {
+    int x = base + a[i].n;
+    a[x].c = i;
+    a[x].D = 1;
+    LR_insert(a, x, a[0].D + a[i].s);
+  }
+}
+
+static void buckets_stop(dlx_t p) {
+  if (!p->cell[0].U) return;
+  p->celln = p->cell[0].U;
+  UD_self(p->cell, 0);
+}
+
+// Returns the column to branch on, and its size via s. There must be at
+// least one column left to cover. The S-heuristic, or minimum remaining
+// values (MRV), picks the first of the smallest columns.
+static int choose_col(dlx_t p, int *s) {
+  cell_ptr a = p->cell;
+  int c = a[0].R;
+  *s = INT_MAX;
+  switch (p->heuristic) {
+  case DLX_BUCKETS:
+    if (a[0].U) {
+      int h = a[0].D;
+      while (a[h].R == h) h++;
+      *s = h - a[0].D;
+      return a[a[h].R].c;
+    }
+    // Fall through: no buckets for this search.
+  default:
+    C(i, 0, R) if (a[i].s < *s) *s = a[c = i].s;
+    break;
+  case DLX_MRV_WEIGHT:
+    C(i, 0, R) {
+      if (a[i].s < *s ||
+          (a[i].s == *s && p->weight[a[i].n] > p->weight[a[c].n])) {
+        *s = a[c = i].s;
+      }
+    }
+    break;
+  case DLX_RANDOM: {
+    // Uniformly among the smallest columns.
+    int ties = 0;
+    C(i, 0, R) {
+      if (a[i].s < *s) *s = a[c = i].s, ties = 1;
+      else if (a[i].s == *s && !rnd(p, ++ties)) c = i;
+    }
+    break;
+  }
+  case DLX_SCORE: {
+    int best = INT_MAX;
+    C(i, 0, R) {
+      int t = p->score(a[i].n, a[i].s);
+      if (t < best) best = t, c = i;
+    }
+    *s = a[c].s;
+    break;
+  }
+  }
+  return c;
+}
+
+// Runs DLX, stopping as soon as found_cb returns nonzero. The matrix is
+// restored on the way out either way. Returns nonzero if stopped early.
+static int solve(dlx_t p,
+                 void (*try_cb)(int, int, int),
+                 void (*undo_cb)(void),
+                 int (*found_cb)(),
+                 void (*stuck_cb)()) {
+  buckets_start(p);
+  cell_ptr a = p->cell;
+  struct dlx_stats_s *st = stats_start(p);
+  // Branch pos[l] of deg[l] is being explored at depth l.
+  int pos[p->ctabn + 1], deg[p->ctabn + 1];
+  int64_t tick = p->progress_every;
+  // Fraction of the tree to the left of the current node, were the tree
+  // as bushy everywhere as it is on the current path.
+  double progress(int l) {
+    double f = 0, w = 1;
+    F(i, l) f += pos[i] * (w /= deg[i]);
+    return f;
+  }
+  int recurse(int l) {
+    STAT(visit(st, l));
+    if (p->progress_cb && !--tick) {
+      p->progress_cb(progress(l));
+      tick = p->progress_every;
+    }
+    if (!a[0].R) {
+      STAT(st->solutions++);
+      return found_cb ? found_cb() : 0;
+    }
+    int s, c = choose_col(p, &s);
+    if (!s) {
+      if (stuck_cb) stuck_cb(a[c].n);
+      return 0;
+    }
+    int stop = 0;
+    deg[l] = s;
+    pos[l] = 0;
+    STAT(st->updates +=) cover_col(a, c);
+    C(r, c, D) {
+      if (try_cb) try_cb(a[c].n, s, a[r].n);
+      C(j, r, R) STAT(st->updates +=) commit(a, j);
+      stop = recurse(l + 1);
+      if (undo_cb) undo_cb();
+      C(j, r, L) uncommit(a, j);
+      if (stop) break;
+      pos[l]++;
+    }
+    uncover_col(a, c);
+    return stop;
+  }
+  int stop = recurse(0);
+  stats_stop(st);
+  buckets_stop(p);
+  return stop;
+}
+
 void dlx_solve(dlx_t p,
                void (*try_cb)(int, int, int),
                void (*undo_cb)(void),
                void (*found_cb)(),
                void (*stuck_cb)()) {
-  void recurse() {
-    cell_ptr c = p->root->R;
-    if (c == p->root) {
-      if (found_cb) found_cb();
-      return;
-    }
-    int s = INT_MAX;  // S-heuristic: choose first most-constrained column.
-    C(i, p->root, R) if (i->s < s) s = (c = i)->s;
-    if (!s) {
-      if (stuck_cb) stuck_cb(c->n);
-      return;
+  int found() {
+    if (found_cb) found_cb();
+    return 0;
+  }
+  solve(p, try_cb, undo_cb, found, stuck_cb);
+}
+
+// Knuth's Algorithm M, for exact covers with multiplicities. A column
+// with bounds [lo, hi] has 'bound' rows left to choose, of which
+// 'bound - slack' are still needed. Branching on a column, each branch picks
+// the next row of the column to choose; rows passed over are tweaked, that
+// is, hidden and taken out of the column until we return. Once no more rows
+// are needed, a last branch chooses none: the column is then done, and
+// deactivated. A column is covered as soon as its bound reaches 0.
+// Runs found_cb on each solution, stopping when it returns nonzero.
+static int mcc_solve(dlx_t p, int (*found_cb)(int[], int)) {
+  cell_ptr a = p->cell;
+  struct dlx_stats_s *st = stats_start(p);
+  int bound[p->ctabn + 1], slack[p->ctabn + 1], sol[p->rtabn + 1], soln = 0;
+  F(k, p->ctabn) bound[k] = p->hi[k], slack[k] = p->hi[k] - p->lo[k];
+  // Commits to the column of cell j of a chosen row, whose cells are already
+  // hidden. Covers the column once no more rows may have a 1 in it.
+  int use(int j) {
+    if (a[j].color) return commit(a, j);
+    return --bound[a[a[j].c].n] ? 0 : cover_col(a, a[j].c);
+  }
+  void unuse(int j) {
+    if (a[j].color) uncommit(a, j);
+    else if (!bound[a[a[j].c].n]++) uncover_col(a, a[j].c);
+  }
+  // Takes cell x out of column c, hiding its row first unless the column is
+  // covered, which hid it already.
+  int tweak(int c, int x, int hidden) {
+    int n = hidden ? 0 : hide(a, x);
+    UD_delete(a, x);
+    a[c].s--;
+    return n;
+  }
+  // Puts back the cells tweaked out of column c, starting with x.
+  void untweak(int c, int x, int hidden) {
+    int y = c, z = a[c].D;
+    a[c].D = x;
+    for (; x != z; y = x, x = a[x].D) {
+      a[x].U = y;
+      a[c].s++;
+      if (!hidden) unhide(a, x);
     }
-    cover_col(c);
-    C(r, c, D) {
-      if (try_cb) try_cb(c->n, s, r->n);
-      C(j, r, R) cover_col(j->c);
-      recurse();
-      if (undo_cb) undo_cb();
-      C(j, r, L) uncover_col(j->c);
+    a[z].U = y;
+  }
+  int recurse(int l) {
+    STAT(visit(st, l));
+    if (!a[0].R) {
+      STAT(st->solutions++);
+      return found_cb(sol, soln);
+    }
+    // Choose the column with the fewest branches.
+    int c = 0, best = INT_MAX;
+    C(i, 0, R) {
+      int need = bound[a[i].n] - slack[a[i].n];
+      int t = a[i].s + 1 - (need > 0 ? need : 0);
+      if (t < best) best = t, c = i;
     }
-    uncover_col(c);
+    if (!best) return 0;
+    int k = a[c].n, stop = 0;
+    if (!--bound[k]) STAT(st->updates +=) cover_col(a, c);
+    void try(int r) {
+      sol[soln++] = a[r].n;
+      C(j, r, R) STAT(st->updates +=) use(j);
+      stop = recurse(l + 1);
+      C(j, r, L) unuse(j);
+      soln--;
+    }
+    if (!bound[k] && !slack[k]) {
+      // An ordinary column, as in DLX.
+      C(r, c, D) {
+        try(r);
+        if (stop) break;
+      }
+      uncover_col(a, c);
+    } else {
+      int first = a[c].D;
+      // Stop once too few rows remain.
+      while (!stop && a[c].s > bound[k] - slack[k]) {
+        int x = a[c].D;
+        if (x == c) {
+          // Choose no more rows of this column.
+          if (bound[k]) LR_delete(a, c);
+          stop = recurse(l + 1);
+          if (bound[k]) LR_restore(a, c);
+          break;
+        }
+        STAT(st->updates +=) tweak(c, x, !bound[k]);
+        try(x);
+      }
+      untweak(c, first, !bound[k]);
+      if (!bound[k]) uncover_col(a, c);
+    }
+    bound[k]++;
+    return stop;
   }
-  recurse();
+  int stop = recurse(0);
+  stats_stop(st);
+  return stop;
 }
 
-void dlx_forall_cover(dlx_t p, void (*cb)(int[], int)) {
+int dlx_forall_cover_until(dlx_t p, int (*cb)(int[], int)) {
+  int count = 0;
+  if (p->bounded) {
+    int found(int sol[], int n) { return count++, cb(sol, n); }
+    mcc_solve(p, found);
+    return count;
+  }
+  if (p->engine == DLX_ITERATIVE) {
+    dlx_search_t s = dlx_search_new(p);
+    int *sol, soln;
+    while ((soln = dlx_search_next(s, &sol)) >= 0 && (count++, !cb(sol, soln)));
+    dlx_search_clear(s);
+    return count;
+  }
   int sol[p->rtabn], soln = 0;
   void cover(int c, int s, int r) { sol[soln++] = r; }
   void uncover() { soln--; }
-  void found() { cb(sol, soln); }
-  dlx_solve(p, cover, uncover, found, NULL);
+  int found() { return count++, cb(sol, soln); }
+  solve(p, cover, uncover, found, NULL);
+  return count;
+}
+
+void dlx_forall_cover(dlx_t p, void (*cb)(int[], int)) {
+  int f(int sol[], int n) { return cb(sol, n), 0; }
+  dlx_forall_cover_until(p, f);
+}
+
+int dlx_first_cover(dlx_t p, void (*cb)(int[], int)) {
+  int f(int sol[], int n) { return cb(sol, n), 1; }
+  return dlx_forall_cover_until(p, f);
+}
+
+// Counts at most 'max' exact covers below a node at depth l. No callbacks,
+// and no solution array.
+static int64_t count_covers(dlx_t p, struct dlx_stats_s *st, int l,
+                            int64_t max) {
+  cell_ptr a = p->cell;
+  STAT(visit(st, l));
+  if (!a[0].R) {
+    STAT(st->solutions++);
+    return 1;
+  }
+  int s, c = choose_col(p, &s);
+  if (!s) return 0;
+  int64_t n = 0;
+  STAT(st->updates +=) cover_col(a, c);
+  C(r, c, D) {
+    C(j, r, R) STAT(st->updates +=) commit(a, j);
+    n += count_covers(p, st, l + 1, max - n);
+    C(j, r, L) uncommit(a, j);
+    if (n >= max) break;
+  }
+  uncover_col(a, c);
+  return n;
+}
+
+// Transposition cache for counting: the number of covers below each set of
+// covered columns, which determines what is left of the matrix, found by
+// its 128-bit Zobrist hash: the XOR of a random key per covered column,
+// updated as columns are covered and uncovered. Entries are not checked
+// beyond the hash. The table is split into sets of CACHE_WAYS entries; a
+// set that is full evicts with the clock algorithm, passing over and
+// clearing the referenced bits of entries hit since the hand last passed.
+// The table starts zeroed, so costs nothing for the pages never touched.
+// A zero hash, as of no columns, marks an empty entry and is never cached.
+enum { CACHE_WAYS = 4 };
+struct cache_s {
+  uint64_t *zobrist;  // Keys of column n: zobrist[2*n] and zobrist[2*n + 1].
+  uint64_t h[2];      // Of the covered columns.
+  struct cache_entry_s {
+    uint64_t key[2];
+    int64_t count;
+  } *entry;
+  uint8_t *ref, *hand;
+  int64_t sets;       // A power of 2.
+};
+
+// Returns a cache that fits in the given bytes, or NULL if none fits.
+static struct cache_s *cache_new(dlx_t p, int64_t bytes) {
+  int64_t per_set = CACHE_WAYS * (sizeof(struct cache_entry_s) + 1) + 1;
+  if (bytes < per_set) return 0;
+  struct cache_s *k = malloc(sizeof(*k));
+  for (k->sets = 1; 2 * k->sets * per_set <= bytes; k->sets *= 2);
+  k->entry = calloc(CACHE_WAYS * k->sets, sizeof(*k->entry));
+  k->ref = calloc(CACHE_WAYS, k->sets);
+  k->hand = calloc(1, k->sets);
+  k->zobrist = malloc(sizeof(uint64_t) * 2 * p->ctabn);
+  uint64_t x = 0;
+  F(i, 2 * p->ctabn) {  // SplitMix64.
+    uint64_t z = (x += 0x9e3779b97f4a7c15);
+    z = (z ^ z >> 30) * 0xbf58476d1ce4e5b9;
+    z = (z ^ z >> 27) * 0x94d049bb133111eb;
+    k->zobrist[i] = z ^ z >> 31;
+  }
+  k->h[0] = k->h[1] = 0;
+  return k;
+}
+
+static void cache_clear(struct cache_s *k) {
+  if (!k) return;
+  free(k->zobrist);
+  free(k->entry);
+  free(k->ref);
+  free(k->hand);
+  free(k);
+}
+
+// Toggles column c of the arena in the hash.
+static void cache_toggle(struct cache_s *k, cell_ptr a, int c) {
+  k->h[0] ^= k->zobrist[2 * a[c].n];
+  k->h[1] ^= k->zobrist[2 * a[c].n + 1];
+}
+
+static int cache_empty(uint64_t *key) { return !key[0] && !key[1]; }
+
+// Returns the entry for the current hash, or NULL.
+static struct cache_entry_s *cache_get(struct cache_s *k) {
+  if (cache_empty(k->h)) return 0;
+  int64_t set = (k->h[0] & (k->sets - 1)) * CACHE_WAYS;
+  F(i, CACHE_WAYS) {
+    struct cache_entry_s *e = k->entry + set + i;
+    if (e->key[0] == k->h[0] && e->key[1] == k->h[1]) {
+      k->ref[set + i] = 1;
+      return e;
+    }
+  }
+  return 0;
+}
+
+static void cache_put(struct cache_s *k, int64_t count) {
+  if (cache_empty(k->h)) return;
+  int64_t set = (k->h[0] & (k->sets - 1)) * CACHE_WAYS;
+  uint8_t *hand = k->hand + set / CACHE_WAYS;
+  int i = 0;
+  while (i < CACHE_WAYS && !cache_empty(k->entry[set + i].key)) i++;
+  if (i == CACHE_WAYS) {
+    while (k->ref[set + *hand]) {
+      k->ref[set + *hand] = 0;
+      *hand = (*hand + 1) % CACHE_WAYS;
+    }
+    i = *hand;
+    *hand = (*hand + 1) % CACHE_WAYS;
+  }
+  struct cache_entry_s *e = k->entry + set + i;
+  e->key[0] = k->h[0];
+  e->key[1] = k->h[1];
+  e->count = count;
+  k->ref[set + i] = 0;
+}
+
+// As count_covers(), but looks up and stores counts in the cache. Only
+// complete counts are stored, that is, those that did not reach 'max'.
+static int64_t count_cached(dlx_t p, struct dlx_stats_s *st, int l,
+                            int64_t max, struct cache_s *k) {
+  cell_ptr a = p->cell;
+  STAT(visit(st, l));
+  if (!a[0].R) {
+    STAT(st->solutions++);
+    return 1;
+  }
+  struct cache_entry_s *e = cache_get(k);
+  if (e) {
+    STAT(st->cache_hits++);
+    return e->count < max ? e->count : max;
+  }
+  int s, c = choose_col(p, &s);
+  if (!s) return 0;
+  int64_t n = 0;
+  STAT(st->updates +=) cover_col(a, c);
+  cache_toggle(k, a, c);
+  C(r, c, D) {
+    C(j, r, R) {
+      STAT(st->updates +=) commit(a, j);
+      cache_toggle(k, a, a[j].c);
+    }
+    n += count_cached(p, st, l + 1, max - n, k);
+    C(j, r, L) {
+      uncommit(a, j);
+      cache_toggle(k, a, a[j].c);
+    }
+    if (n >= max) break;
+  }
+  cache_toggle(k, a, c);
+  uncover_col(a, c);
+  if (n < max) cache_put(k, n);
+  return n;
+}
+
+int64_t dlx_count_covers(dlx_t p, int64_t max) {
+  if (max <= 0) max = INT64_MAX;
+  if (p->bounded) {
+    int64_t n = 0;
+    int found(int sol[], int soln) { return ++n >= max; }
+    mcc_solve(p, found);
+    return n;
+  }
+  if (p->engine == DLX_ITERATIVE) {
+    dlx_search_t s = dlx_search_new(p);
+    int *sol;
+    int64_t n = 0;
+    while (n < max && dlx_search_next(s, &sol) >= 0) n++;
+    dlx_search_clear(s);
+    return n;
+  }
+  // With colors, purified columns are part of what is left, so no cache.
+  struct cache_s *k = 0;
+  if (p->cache_bytes) {
+    int colors = 0;
+    F(i, p->celln) colors |= p->cell[i].color;
+    if (!colors) k = cache_new(p, p->cache_bytes);
+  }
+  struct dlx_stats_s *st = stats_start(p);
+  buckets_start(p);
+  int64_t n = k ? count_cached(p, st, 0, max, k) : count_covers(p, st, 0, max);
+  buckets_stop(p);
+  stats_stop(st);
+  cache_clear(k);
+  return n;
+}
+
+void dlx_set_cache(dlx_t p, int64_t bytes) {
+  p->cache_bytes = bytes > 0 ? bytes : 0;
+}
+
+void dlx_set_engine(dlx_t p, int engine) { p->engine = engine; }
+
+void dlx_set_progress(dlx_t p, int64_t every, void (*cb)(double)) {
+  p->progress_cb = every > 0 ? cb : 0;
+  p->progress_every = every;
+}
+
+// Knuth's estimate: follow a random path down the tree, choosing columns as
+// the search does. A node reached through branches of degrees s_1, ..., s_l
+// stands for s_1 * ... * s_l nodes at its depth.
+double dlx_estimate(dlx_t p, int probes, unsigned seed, double *covers) {
+  cell_ptr a = p->cell;
+  uint64_t x = seed + 0x9e3779b97f4a7c15;
+  int rnd(int n) {  // Xorshift.
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return x % n;
+  }
+  int cs[p->ctabn + 1], rs[p->ctabn + 1];
+  double nodes = 0, found = 0;
+  F(probe, probes) {
+    double w = 1;
+    int l = 0;
+    for (;;) {
+      nodes += w;
+      if (!a[0].R) {
+        found += w;
+        break;
+      }
+      int s, c = choose_col(p, &s);
+      if (!s) break;
+      w *= s;
+      int r = a[c].D;
+      for (int i = rnd(s); i; i--) r = a[r].D;
+      cover_col(a, c);
+      C(j, r, R) commit(a, j);
+      cs[l] = c;
+      rs[l++] = r;
+    }
+    while (l--) {
+      C(j, rs[l], L) uncommit(a, j);
+      uncover_col(a, cs[l]);
+    }
+  }
+  if (probes < 1) probes = 1;
+  if (covers) *covers = found / probes;
+  return nodes / probes;
+}
+
+// Iterative search: Knuth's Algorithm X with an explicit stack of levels
+// instead of recursion, so it can return at each solution and later resume.
+// Level l covers column cs[l] with row x[l], or has tried every row if
+// x[l] == cs[l].
+struct dlx_search_s {
+  dlx_t p;
+  int l, started, done;
+  int *x, *cs, *sol;
+};
+
+// Starts a search without touching the statistics.
+static dlx_search_t search_new(dlx_t p) {
+  dlx_search_t s = malloc(sizeof(*s));
+  s->p = p;
+  s->l = s->started = s->done = 0;
+  // Each level covers a distinct column.
+  s->x = malloc(sizeof(int) * (p->ctabn + 1));
+  s->cs = malloc(sizeof(int) * (p->ctabn + 1));
+  s->sol = malloc(sizeof(int) * (p->ctabn + 1));
+  return s;
+}
+
+dlx_search_t dlx_search_new(dlx_t p) {
+  stats_stop(stats_start(p));  // Only time spent in dlx_search_next() counts.
+  return search_new(p);
+}
+
+// Finds the next exact cover, and returns the number of rows in it, or -1.
+// The time taken is added to the statistics by dlx_search_next().
+static int search_next(dlx_search_t s, int **rows) {
+  if (s->done) return -1;
+  cell_ptr a = s->p->cell;
+  STAT(struct dlx_stats_s *st = &s->p->stats);
+  int *x = s->x, *cs = s->cs, l = s->l;
+  if (s->started) goto backtrack;
+  s->started = 1;
+enter:  // X2.
+  STAT(visit(st, l));
+  if (!a[0].R) {
+    STAT(st->solutions++);
+    s->l = l;
+    F(i, l) s->sol[i] = a[x[i]].n;
+    *rows = s->sol;
+    return l;
+  }
+  int n;
+  cs[l] = choose_col(s->p, &n);  // X3.
+  if (!n) goto backtrack;
+  STAT(st->updates +=) cover_col(a, cs[l]);  // X4.
+  x[l] = a[cs[l]].D;
+try:  // X5.
+  if (x[l] == cs[l]) {
+    uncover_col(a, cs[l]);  // X7.
+    goto backtrack;
+  }
+  C(j, x[l], R) STAT(st->updates +=) commit(a, j);
+  l++;
+  goto enter;
+retry:  // X6.
+  C(j, x[l], L) uncommit(a, j);
+  x[l] = a[x[l]].D;
+  goto try;
+backtrack:  // X8.
+  if (!l) {
+    s->done = 1;
+    s->l = 0;
+    return -1;
+  }
+  l--;
+  goto retry;
+}
+
+int dlx_search_next(dlx_search_t s, int **rows) {
+  struct dlx_stats_s *st = &s->p->stats;
+  STAT(st->seconds -= now());
+  int n = search_next(s, rows);
+  stats_stop(st);
+  return n;
+}
+
+void dlx_search_clear(dlx_search_t s) {
+  // Unwind any levels still in progress.
+  if (!s->done) {
+    cell_ptr a = s->p->cell;
+    int *x = s->x, *cs = s->cs;
+    for (int l = s->l; l--;) {
+      C(j, x[l], L) uncommit(a, j);
+      uncover_col(a, cs[l]);
+    }
+  }
+  free(s->x);
+  free(s->cs);
+  free(s->sol);
+  free(s);
+}
+
+// Parallel search. The tree is cut at depth k; each node at that depth is a
+// task, described by the k rows leading to it. Tasks are dealt in contiguous
+// ranges to workers, each with its own copy of the matrix. A worker takes
+// tasks from the front of its own range, and once that is empty, steals from
+// the back of the others.
+struct par_s {
+  int k, nthreads;
+  int *task;  // Task i is the prefix task[i*k .. i*k + k - 1].
+  int64_t *task_count;
+  void (*cb)(int[], int, int);
+  struct worker_s *worker;
+};
+
+struct worker_s {
+  struct par_s *par;
+  dlx_t dlx;
+  int id;
+  uint64_t range;  // Front index in the high 32 bits, end in the low 32 bits.
+};
+
+static int take_task(struct worker_s *w, int steal) {
+  uint64_t v = __atomic_load_n(&w->range, __ATOMIC_ACQUIRE);
+  for (;;) {
+    uint32_t lo = v >> 32, hi = v;
+    if (lo >= hi) return -1;
+    uint64_t next = steal ? (uint64_t) lo << 32 | (hi - 1)
+                          : (uint64_t) (lo + 1) << 32 | hi;
+    if (__atomic_compare_exchange_n(&w->range, &v, next, 0,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      return steal ? hi - 1 : lo;
+    }
+  }
+}
+
+static void *par_worker(void *arg) {
+  struct worker_s *w = arg;
+  struct par_s *par = w->par;
+  cell_ptr a = w->dlx->cell;
+  int k = par->k;
+  // Tasks add to the worker's statistics, which are merged at the end.
+  struct dlx_stats_s *st = stats_start(w->dlx);
+  for (;;) {
+    int t = take_task(w, 0);
+    for (int i = 1; t < 0 && i < par->nthreads; i++) {
+      t = take_task(par->worker + (w->id + i) % par->nthreads, 1);
+    }
+    if (t < 0) break;
+    int *pre = par->task + t * k;
+    F(l, k) choose_row(a, pre[l]);
+    if (par->cb) {
+      dlx_search_t s = search_new(w->dlx);
+      int rows[k + w->dlx->ctabn], *r, n;
+      F(l, k) rows[l] = a[pre[l]].n;
+      int64_t count = 0;
+      while ((n = search_next(s, &r)) >= 0) {
+        memcpy(rows + k, r, sizeof(int) * n);
+        par->cb(rows, k + n, w->id);
+        count++;
+      }
+      dlx_search_clear(s);
+      par->task_count[t] = count;
+    } else {
+      par->task_count[t] = count_covers(w->dlx, st, 0, INT64_MAX);
+    }
+    for (int l = k; l--;) unchoose_row(a, pre[l]);
+  }
+  return 0;
+}
+
+int64_t dlx_forall_cover_parallel(dlx_t p, int nthreads,
+                                  void (*cb)(int[], int, int)) {
+  if (nthreads < 1) nthreads = 1;
+  if (p->bounded) {
+    // Bounds are beyond the workers, so search on this thread.
+    int64_t n = 0;
+    int found(int sol[], int soln) {
+      if (cb) cb(sol, soln, 0);
+      return n++, 0;
+    }
+    mcc_solve(p, found);
+    return n;
+  }
+  cell_ptr a = p->cell;
+  struct dlx_stats_s *st = stats_start(p);
+  int rows[p->ctabn + 1];
+  int k = 0, taskn = 1, *task = malloc(sizeof(int));
+  int64_t shallow = 0;  // Covers found above depth k.
+  // Cut deep enough that there are plenty of tasks to go around. Each pass
+  // replaces the nodes at depth k by their children, so every node above the
+  // cut is expanded once, and counts towards the statistics here; the
+  // workers count the rest. Deepening stops once the frontier is big enough,
+  // has run out, or has stopped growing.
+  while (taskn && taskn < 16 * nthreads) {
+    int nextn = 0, next_max = 16;
+    int *next = malloc(sizeof(int) * (k + 1) * next_max);
+    F(t, taskn) {
+      int *pre = task + t * k;
+      F(l, k) choose_row(a, pre[l]);
+      STAT(visit(st, k));
+      int s, c;
+      if (!a[0].R) {
+        STAT(st->solutions++);
+        shallow++;
+        F(l, k) rows[l] = a[pre[l]].n;
+        if (cb) cb(rows, k, 0);
+      } else if (c = choose_col(p, &s), s) {
+        int u = cover_col(a, c);
+        C(r, c, D) {
+          C(j, r, R) u += commit(a, j);
+          if (nextn == next_max) {
+            next = realloc(next, sizeof(int) * (k + 1) * (next_max *= 2));
+          }
+          memcpy(next + nextn * (k + 1), pre, sizeof(int) * k);
+          next[nextn++ * (k + 1) + k] = r;
+          C(j, r, L) uncommit(a, j);
+        }
+        uncover_col(a, c);
+        STAT(st->updates += u);
+      }
+      for (int l = k; l--;) unchoose_row(a, pre[l]);
+    }
+    free(task);
+    int grew = nextn > taskn;
+    task = next, taskn = nextn, k++;
+    if (!grew) break;
+  }
+
+  struct par_s par = {
+    .k = k,
+    .nthreads = nthreads,
+    .task = task,
+    .task_count = malloc(sizeof(int64_t) * (taskn + 1)),
+    .cb = cb,
+    .worker = malloc(sizeof(struct worker_s) * nthreads),
+  };
+  pthread_t thread[nthreads];
+  F(i, nthreads) {
+    struct worker_s *w = par.worker + i;
+    w->par = &par;
+    w->dlx = dlx_clone(p);
+    w->id = i;
+    w->range = (uint64_t) (taskn * i / nthreads) << 32 |
+               (uint32_t) (taskn * (i + 1) / nthreads);
+  }
+  F(i, nthreads) pthread_create(thread + i, 0, par_worker, par.worker + i);
+  F(i, nthreads) pthread_join(thread[i], 0);
+
+  int64_t count = shallow;
+  F(i, taskn) count += par.task_count[i];
+  F(i, nthreads) {
+    STAT(stats_add(st, &par.worker[i].dlx->stats, k));
+    dlx_clear(par.worker[i].dlx);
+  }
+  stats_stop(st);
+  free(par.worker);
+  free(par.task_count);
+  free(task);
+  return count;
+}
+
+// The exact covers as a ZDD, or at least a DAG read like one: node x stands
+// for the covers that contain row[x] along with a cover in the family of
+// hi[x], and those of the family of lo[x]. Node 0 is the empty family and
+// node 1 the family of the empty cover. Nodes come after their children.
+// Every node other than 0 has at least one cover, so walks never get stuck.
+struct dlx_zdd_s {
+  int n, alloc, root;
+  int *row, *lo, *hi;
+  int64_t *count;  // Covers in the family of each node.
+};
+
+static int zdd_node(dlx_zdd_t z, int row, int lo, int hi) {
+  if (z->n == z->alloc) {
+    z->alloc *= 2;
+    z->row = realloc(z->row, sizeof(int) * z->alloc);
+    z->lo = realloc(z->lo, sizeof(int) * z->alloc);
+    z->hi = realloc(z->hi, sizeof(int) * z->alloc);
+    z->count = realloc(z->count, sizeof(int64_t) * z->alloc);
+  }
+  z->row[z->n] = row;
+  z->lo[z->n] = lo;
+  z->hi[z->n] = hi;
+  z->count[z->n] = z->count[lo] + z->count[hi];
+  return z->n++;
+}
+
+// Knuth's DLX with memoization: what is left to cover depends only on which
+// columns are covered, so the node for each set of covered columns met is
+// kept in an open addressing table, and is built only once. A branch on
+// column c becomes a chain of nodes, one per row of c that leads to covers.
+dlx_zdd_t dlx_zdd(dlx_t p) {
+  cell_ptr a = p->cell;
+  if (p->bounded) return 0;
+  F(i, p->celln) if (a[i].color) return 0;
+  dlx_zdd_t z = malloc(sizeof(*z));
+  z->n = 0;
+  z->alloc = 64;
+  z->row = malloc(sizeof(int) * z->alloc);
+  z->lo = malloc(sizeof(int) * z->alloc);
+  z->hi = malloc(sizeof(int) * z->alloc);
+  z->count = malloc(sizeof(int64_t) * z->alloc);
+  F(i, 2) {
+    z->row[i] = -1;
+    z->lo[i] = z->hi[i] = i;
+    z->count[i] = i;
+  }
+  z->n = 2;
+
+  struct dlx_stats_s *st = stats_start(p);
+  // Covered columns as a bitset, and the table: slot[] holds 1 + the index
+  // of an entry, whose key is the bitset key[i*nw .. i*nw + nw - 1] and whose
+  // node is val[i].
+  int nw = p->ctabn / 64 + 1, cap = 1024, n = 0, alloc = 1024;
+  uint64_t cov[nw], *key = malloc(sizeof(uint64_t) * nw * alloc);
+  int *slot = calloc(cap, sizeof(int)), *val = malloc(sizeof(int) * alloc);
+  memset(cov, 0, sizeof(cov));
+  void toggle(int c) { cov[a[c].n / 64] ^= 1ull << a[c].n % 64; }
+  // Returns the slot of bitset k, or the empty slot it would go in.
+  int *lookup(uint64_t *k) {
+    uint64_t h = 0;
+    F(i, nw) h = (h ^ k[i]) * 0x9e3779b97f4a7c15;
+    for (uint32_t i = h >> 32;; i++) {
+      int *s = slot + (i & (cap - 1));
+      if (!*s || !memcmp(key + (int64_t) (*s - 1) * nw, k, sizeof(cov))) {
+        return s;
+      }
+    }
+  }
+  void insert(int x) {
+    if (2 * (n + 1) > cap) {
+      free(slot);
+      slot = calloc(cap *= 2, sizeof(int));
+      F(i, n) *lookup(key + (int64_t) i * nw) = i + 1;
+    }
+    if (n == alloc) {
+      key = realloc(key, sizeof(uint64_t) * nw * (alloc *= 2));
+      val = realloc(val, sizeof(int) * alloc);
+    }
+    *lookup(cov) = n + 1;
+    memcpy(key + (int64_t) n * nw, cov, sizeof(cov));
+    val[n++] = x;
+  }
+  int build(int l) {
+    STAT(visit(st, l));
+    if (!a[0].R) {
+      STAT(st->solutions++);
+      return 1;
+    }
+    int *s = lookup(cov);
+    if (*s) return val[*s - 1];
+    int size, c = choose_col(p, &size), x = 0;
+    if (size) {
+      STAT(st->updates +=) cover_col(a, c);
+      toggle(c);
+      // Bottom up, so the chain lists the rows in the order of the column.
+      C(r, c, U) {
+        C(j, r, R) {
+          STAT(st->updates +=) commit(a, j);
+          toggle(a[j].c);
+        }
+        int y = build(l + 1);
+        C(j, r, L) {
+          uncommit(a, j);
+          toggle(a[j].c);
+        }
+        if (y) x = zdd_node(z, a[r].n, x, y);
+      }
+      toggle(c);
+      uncover_col(a, c);
+    }
+    insert(x);
+    return x;
+  }
+  z->root = build(0);
+  stats_stop(st);
+  free(slot);
+  free(key);
+  free(val);
+  return z;
+}
+
+int dlx_zdd_nodes(dlx_zdd_t z) { return z->n - 2; }
+
+int64_t dlx_zdd_count(dlx_zdd_t z) { return z->count[z->root]; }
+
+// Walks down from the root, taking the hi branch for the t-th cover in the
+// order of the lo branch's covers first.
+int dlx_zdd_sample(dlx_zdd_t z, unsigned seed, int rows[]) {
+  if (!z->root) return -1;
+  // SplitMix64.
+  uint64_t x = seed + 0x9e3779b97f4a7c15;
+  x = (x ^ x >> 30) * 0xbf58476d1ce4e5b9;
+  x = (x ^ x >> 27) * 0x94d049bb133111eb;
+  int64_t t = (x ^ x >> 31) % z->count[z->root];
+  int n = 0;
+  for (int i = z->root; i > 1;) {
+    if (t < z->count[z->lo[i]]) i = z->lo[i];
+    else {
+      t -= z->count[z->lo[i]];
+      rows[n++] = z->row[i];
+      i = z->hi[i];
+    }
+  }
+  return n;
+}
+
+int dlx_zdd_best(dlx_zdd_t z, const double *weight, int rows[], double *total) {
+  if (!z->root) return -1;
+  // Children come first, so one pass finds the best of every node.
+  double *best = malloc(sizeof(double) * z->n);
+  best[1] = 0;
+  for (int i = 2; i < z->n; i++) {
+    double w = weight[z->row[i]] + best[z->hi[i]];
+    best[i] = z->lo[i] && best[z->lo[i]] >= w ? best[z->lo[i]] : w;
+  }
+  if (total) *total = best[z->root];
+  int n = 0;
+  for (int i = z->root; i > 1;) {
+    if (z->lo[i] && best[z->lo[i]] >= weight[z->row[i]] + best[z->hi[i]]) {
+      i = z->lo[i];
+    } else {
+      rows[n++] = z->row[i];
+      i = z->hi[i];
+    }
+  }
+  free(best);
+  return n;
+}
+
+void dlx_zdd_clear(dlx_zdd_t z) {
+  free(z->row);
+  free(z->lo);
+  free(z->hi);
+  free(z->count);
+  free(z);
 }
@@ -5,6 +5,8 @@
 //
 // Row and column numbers are 0-indexed.
 
+#include <stdint.h>
+
 struct dlx_s;
 typedef struct dlx_s *dlx_t;
 
@@ -14,6 +16,11 @@ dlx_t dlx_new();
 // Frees exact cover problem.
 void dlx_clear(dlx_t dlx);
 
+// Removes every row and column, so another problem can be built in the
+// memory of this one. Keeps the engine, heuristic, seed, score, progress
+// hook and cache size.
+void dlx_empty(dlx_t dlx);
+
 // Returns number of rows.
 int dlx_rows(dlx_t dlx);
 
@@ -24,24 +31,248 @@ int dlx_cols(dlx_t dlx);
 // Increases the number of rows and columns if necessary.
 void dlx_set(dlx_t dlx, int row, int col);
 
+// Appends a row with a 1 in each of the n given columns, ignoring repeats,
+// and returns its row number. Increases the number of columns if necessary.
+// Much faster than a dlx_set() per 1 for long rows. Returns -1 if a column
+// is negative.
+int dlx_add_row(dlx_t dlx, const int *cols, int n);
+
+// Returns a new exact cover problem from a matrix in compressed sparse row
+// form: row r has a 1 in the columns col_idx[row_ptr[r]] to
+// col_idx[row_ptr[r + 1] - 1]. There are at least 'ncols' columns. Builds
+// the whole matrix in one pass. Returns NULL if a column is negative.
+dlx_t dlx_from_csr(int nrows, int ncols, const int *row_ptr,
+                   const int *col_idx);
+
 // Marks a column as optional: a solution need not cover the given column,
 // but it still must respect the constraints it entails.
 void dlx_mark_optional(dlx_t dlx, int col);
 
+// Lets between lo and hi rows of a solution have a 1 in the given column,
+// instead of exactly one (Knuth's exact covering with multiplicities, MCC).
+// For an optional column, lo is ignored. Returns 0 on success, or -1 unless
+// 0 <= lo <= hi and hi >= 1.
+//
+// Once bounds are set, dlx_forall_cover(), dlx_forall_cover_until(),
+// dlx_first_cover(), dlx_count_covers() and dlx_forall_cover_parallel() use
+// a search that honors them, whatever the engine; the parallel search then
+// runs on one thread. Other searches, and dlx_pick_row(), still treat each
+// column as if its bounds were [1, 1].
+int dlx_set_bounds(dlx_t dlx, int col, int lo, int hi);
+
+// Places a 1 of the given color in the given row and column, which is marked
+// optional. Rows of a solution may then share the column, as long as they
+// all give it the same color (Knuth's exact covering with colors, XCC). A 1
+// placed by dlx_set(), or with color 0, clashes with every other 1 in the
+// column, whatever its color. Colors are positive.
+void dlx_set_color(dlx_t dlx, int row, int col, int color);
+
 // Removes a row from consideration. Returns 0 on success, -1 otherwise.
 // Should only be called after all dlx_set() calls.
 int dlx_remove_row(dlx_t p, int row);
 
-// Picks a row to be part of the solution. Returns 0 on success, -1 otherwise.
+// Picks a row to be part of the solution. Returns 0 on success, -1 otherwise,
+// for example when the row clashes with a row already picked.
 // Should only be called after all dlx_set() calls and dlx_remove_row() calls.
-// TODO: Check the row can be legally chosen.
 int dlx_pick_row(dlx_t dlx, int row);
 
+// Returns a checkpoint for dlx_undo(): a count of the dlx_pick_row() and
+// dlx_remove_row() calls so far.
+int dlx_mark(dlx_t dlx);
+
+// Undoes all dlx_pick_row() and dlx_remove_row() calls made since the given
+// checkpoint, most recent first.
+void dlx_undo(dlx_t dlx, int mark);
+
+// Undoes all dlx_pick_row() and dlx_remove_row() calls.
+void dlx_reset(dlx_t dlx);
+
+// Returns a copy of an exact cover problem, including rows picked and
+// removed so far. Costs little more than a memcpy() of the cells, so it is
+// cheaper to clone a prebuilt instance than to rebuild it with dlx_set().
+dlx_t dlx_clone(dlx_t dlx);
+
+// Writes an exact cover problem to a file in a compact binary form: its
+// rows, optional columns, colors, bounds, and the rows picked and removed so
+// far. Integers are stored in native byte order, so files are only portable
+// between machines of the same endianness. Returns 0 on success, -1
+// otherwise.
+int dlx_save(dlx_t dlx, const char *filename);
+
+// Reads an exact cover problem written by dlx_save(). The file is mapped
+// into memory and the matrix built straight from it, in one pass. Returns
+// NULL if the file cannot be read or is malformed, including when its trail
+// of picked and removed rows cannot be replayed.
+dlx_t dlx_load(const char *filename);
+
 // Runs the DLX algorithm, and for every exact cover, calls the given callback
 // with an array containing all the row numbers of the solution and the size of
 // said array.
 void dlx_forall_cover(dlx_t dlx, void (*cb)(int rows[], int n));
 
+// As above, but stops the search as soon as the callback returns nonzero.
+// Either way, the matrix is left as it was before the call.
+// Returns the number of times the callback was called.
+int dlx_forall_cover_until(dlx_t dlx, int (*cb)(int rows[], int n));
+
+// Calls the given callback on the first exact cover found, if any, then
+// stops searching. Returns 1 if a cover was found, 0 otherwise.
+int dlx_first_cover(dlx_t dlx, void (*cb)(int rows[], int n));
+
+// Returns the number of exact covers, counting no further than 'max' if it is
+// positive. For example, max = 2 suffices to check a solution is unique.
+// Faster than counting with dlx_forall_cover() as no solutions are recorded.
+int64_t dlx_count_covers(dlx_t dlx, int64_t max);
+
+// Lets dlx_count_covers() keep a cache of at most 'bytes' bytes, with the
+// number of covers below each set of covered columns it has counted, and
+// look up rather than count again when rows chosen in a different order
+// lead to the same set. Pays off on problems with many such transpositions,
+// such as tilings. When the cache is full, entries not hit lately make way
+// for new ones. Sets are told apart by a 128-bit hash, so the
+// count is only wrong if two sets collide, which is vanishingly unlikely.
+// Only the recursive engine uses the cache, and not with colors or bounds.
+// The cache is built afresh by each call. Turned off when 'bytes' is 0, the
+// default.
+void dlx_set_cache(dlx_t dlx, int64_t bytes);
+
+// Searches for exact covers with the given number of threads, each working on
+// its own copy of the matrix. Unless the callback is NULL, calls it for every
+// exact cover with the row numbers of the solution, the size of said array,
+// and the index of the calling thread. Calls may be concurrent, and arrive in
+// no particular order. Returns the number of exact covers.
+int64_t dlx_forall_cover_parallel(dlx_t dlx, int nthreads,
+                                  void (*cb)(int rows[], int n, int thread));
+
+// Search engines for dlx_forall_cover(), dlx_forall_cover_until(),
+// dlx_first_cover() and dlx_count_covers(). The default DLX_RECURSIVE engine
+// recurses once per level; DLX_ITERATIVE runs the same search with an
+// explicit stack of levels.
+enum { DLX_RECURSIVE, DLX_ITERATIVE };
+void dlx_set_engine(dlx_t dlx, int engine);
+
+// Rules for choosing the column to branch on, among those left to cover:
+//
+//  * DLX_MRV, the default: the first of the columns with the fewest rows.
+//  * DLX_MRV_WEIGHT: as above, but ties go to the column of greatest weight.
+//  * DLX_RANDOM: a column with the fewest rows, chosen uniformly at random.
+//  * DLX_SCORE: the first column with the lowest score.
+//  * DLX_BUCKETS: as DLX_MRV, though ties may be broken differently. Keeps
+//    the columns in buckets by size rather than scanning them all at each
+//    node, but costs more per update. In `make bench` it wins on 9x9
+//    sudokus, and loses on the pentominoes and on the 16x16 sudokus, where
+//    its ties also lead to a bigger tree. Only the recursive engine keeps
+//    buckets; other searches scan.
+//
+// Searches with bounds from dlx_set_bounds() ignore these, and use their own.
+enum { DLX_MRV, DLX_MRV_WEIGHT, DLX_RANDOM, DLX_SCORE, DLX_BUCKETS };
+void dlx_set_heuristic(dlx_t dlx, int heuristic);
+
+// Sets the weight of a column for DLX_MRV_WEIGHT. Weights start at 0.
+void dlx_set_weight(dlx_t dlx, int col, int weight);
+
+// Seeds the generator for DLX_RANDOM.
+void dlx_set_seed(dlx_t dlx, unsigned seed);
+
+// Selects DLX_SCORE, with the given callback, which is passed a column and
+// the number of rows that can cover it.
+void dlx_set_score(dlx_t dlx, int (*score)(int col, int size));
+
+// Makes dlx_solve(), and dlx_forall_cover(), dlx_forall_cover_until() and
+// dlx_first_cover() with the recursive engine, call the given callback every
+// 'every' nodes of the search tree with an estimate of the fraction of the
+// tree explored so far, between 0 and 1. The estimate treats each branch at
+// a node as equally big, so it can jump around on lopsided trees. No other
+// search reports progress: not the iterative engine, nor searches with
+// bounds, nor dlx_count_covers(), dlx_forall_cover_parallel() or dlx_zdd().
+// Turned off when 'every' is 0.
+void dlx_set_progress(dlx_t dlx, int64_t every, void (*cb)(double fraction));
+
+// Estimates the number of nodes of the search tree, as counted by dlx_stats(),
+// by averaging 'probes' random walks from the root to a leaf, seeded with
+// 'seed'. Unless 'covers' is NULL, also estimates the number of exact covers.
+// Exact for trees where nodes at the same depth have the same branching; the
+// error shrinks with more probes. Each probe costs about as much as finding
+// one exact cover, so it is cheap to decide how to run a search. Only for
+// problems without bounds: the walks ignore dlx_set_bounds(), and so
+// estimate a tree other than the one searches with bounds explore.
+double dlx_estimate(dlx_t dlx, int probes, unsigned seed, double *covers);
+
+// A search in progress, using the iterative engine. Searches can be paused
+// after any solution and resumed later. Searches share no state other than
+// the instance they dance on, so only one search per instance may be in
+// progress at a time.
+struct dlx_search_s;
+typedef struct dlx_search_s *dlx_search_t;
+
+// Starts a search. The instance must not be modified until the search is
+// cleared.
+dlx_search_t dlx_search_new(dlx_t dlx);
+
+// Finds the next exact cover. Returns the number of rows in it, and points
+// 'rows' at the row numbers, which are valid until the next call. Returns -1
+// once there are no more exact covers.
+int dlx_search_next(dlx_search_t search, int **rows);
+
+// Ends a search, which need not have finished, and restores the instance.
+void dlx_search_clear(dlx_search_t search);
+
+// All the exact covers, held in a zero-suppressed decision diagram (ZDD).
+// Built by a search that remembers what it found below each set of covered
+// columns, so problems with billions of covers can fit in a few nodes, and
+// be counted, sampled and optimized over without listing them.
+struct dlx_zdd_s;
+typedef struct dlx_zdd_s *dlx_zdd_t;
+
+// Builds the ZDD of the exact covers, which like the solutions of the
+// functions above, leave out the rows picked with dlx_pick_row(). Returns
+// NULL if the instance has colors or bounds, which the ZDD does not handle.
+dlx_zdd_t dlx_zdd(dlx_t dlx);
+
+// Returns the number of nodes of the ZDD.
+int dlx_zdd_nodes(dlx_zdd_t zdd);
+
+// Returns the number of exact covers, which must be less than 2^63.
+int64_t dlx_zdd_count(dlx_zdd_t zdd);
+
+// Fills 'rows' with an exact cover chosen uniformly at random, by 'seed',
+// and returns the number of rows in it, or -1 if there are no covers.
+// There must be room in 'rows' for a row per column of the instance.
+int dlx_zdd_sample(dlx_zdd_t zdd, unsigned seed, int rows[]);
+
+// Fills 'rows' with an exact cover of greatest weight, where weight[r] is
+// the weight of row r and the weight of a cover is the sum of the weights of
+// its rows, and returns the number of rows in it, or -1 if there are no
+// covers. Unless 'total' is NULL, sets it to the weight of the cover.
+int dlx_zdd_best(dlx_zdd_t zdd, const double *weight, int rows[],
+                 double *total);
+
+// Frees a ZDD.
+void dlx_zdd_clear(dlx_zdd_t zdd);
+
+// Counters for the last search on an instance, by any of the functions
+// above, including dlx_zdd(), the functions below, or dlx_solve(). The tree
+// has a node for every partial solution visited, and the depth of a node is
+// the number of rows picked by the search so far. When built with
+// -DDLX_NO_STATS, no counting is done and the counters stay 0.
+struct dlx_stats_s {
+  int64_t nodes;      // Search tree nodes, including the root.
+  int64_t updates;    // Links removed when covering columns.
+  int64_t solutions;  // Exact covers found.
+  int max_depth;      // Depth of the deepest node.
+  // profile[l] is the number of nodes at depth l, for l <= max_depth. The
+  // average branching at depth l is profile[l + 1] / profile[l].
+  int64_t *profile;
+  double seconds;     // Time taken by the search.
+  // Subtrees whose count was found in the cache of dlx_set_cache(), and so
+  // not searched, nor counted in the other fields.
+  int64_t cache_hits;
+};
+
+// Returns the counters of the last search. They belong to the instance, and
+// are overwritten by the next search.
+struct dlx_stats_s *dlx_stats(dlx_t dlx);
+
 // Runs the DLX algorithm, calling the appropriate callback when:
 //
 //  * a column is covered by selectng a row (cover_cb)
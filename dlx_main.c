@@ -0,0 +1,244 @@
+// = dlx =
+//
+// Solves exact cover problems read from standard input, in the format of
+// Knuth's DLX programs. Lines starting with '|' are comments, as are blank
+// lines. The first other line names the items, that is, the columns:
+// primary items, then optionally '|' and secondary items. Every line after
+// that is an option, that is, a row, listing the items it covers:
+//
+//   | Rows 0 and 2, or row 3 alone.
+//   a b | c
+//   a c
+//   b c
+//   b
+//   a b
+//
+// A secondary item in an option may be followed by ':' and a color, as in
+// "x:red". Options sharing a secondary item must then give it the same
+// color, and an uncolored secondary item clashes with every other option
+// that has it. A primary item may be preceded by its multiplicity: "lo:hi|a"
+// means a solution covers 'a' between lo and hi times, and "n|a" exactly n
+// times.
+//
+// Prints every solution: its options as they were written, then a blank
+// line. With -1, stops after the first solution. With -c, prints only the
+// number of solutions, and with -r, prints each solution as the numbers of
+// its options, counting from 0, on one line, without keeping the text of the
+// options. Options are added to the matrix as they are read, and output is
+// fully buffered, so large problems can be piped in and out.
+
+#define _GNU_SOURCE
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "dlx.h"
+
+#define F(i, n) for(int i=0; i<n; i++)
+
+#define NORETURN __attribute__((__noreturn__))
+void die(const char *err, ...) NORETURN __attribute__((format (printf, 1, 2)));
+void die(const char *err, ...) {
+  va_list params;
+  va_start(params, err);
+  vfprintf(stderr, err, params);
+  fputc('\n', stderr);
+  va_end(params);
+  exit(1);
+}
+
+// Names, interned in an open addressing table. Each distinct name gets the
+// next number, starting from 0.
+struct intern_s {
+  char **key;   // Slots, NULL when empty.
+  int *id;
+  int cap, n;
+};
+typedef struct intern_s *intern_t;
+
+static uint32_t hash(const char *s) {
+  uint32_t h = 2166136261u;
+  for (; *s; s++) h = (h ^ (unsigned char) *s) * 16777619u;
+  return h;
+}
+
+// Returns the slot holding the given name, or the empty slot it would go in.
+static int slot_of(intern_t t, const char *s) {
+  uint32_t i = hash(s) & (t->cap - 1);
+  while (t->key[i] && strcmp(t->key[i], s)) i = (i + 1) & (t->cap - 1);
+  return i;
+}
+
+// Returns the number of the given name, or -1 if it is new and 'add' is 0.
+// Keeps the table at most half full.
+static int intern(intern_t t, const char *s, int add) {
+  if (2 * (t->n + 1) > t->cap) {
+    struct intern_s old = *t;
+    t->cap = old.cap ? 2 * old.cap : 64;
+    t->key = calloc(t->cap, sizeof(char *));
+    t->id = malloc(sizeof(int) * t->cap);
+    F(i, old.cap) if (old.key[i]) {
+      int k = slot_of(t, old.key[i]);
+      t->key[k] = old.key[i];
+      t->id[k] = old.id[i];
+    }
+    free(old.key);
+    free(old.id);
+  }
+  int i = slot_of(t, s);
+  if (t->key[i]) return t->id[i];
+  if (!add) return -1;
+  t->key[i] = strdup(s);
+  return t->id[i] = t->n++;
+}
+
+static void intern_clear(intern_t t) {
+  F(i, t->cap) free(t->key[i]);
+  free(t->key);
+  free(t->id);
+}
+
+int main(int argc, char *argv[]) {
+  int first = 0, count_only = 0, numbers = 0, opt;
+  while ((opt = getopt(argc, argv, "1cr")) != -1) {
+    if (opt == '1') first++;
+    else if (opt == 'c') count_only++;
+    else if (opt == 'r') numbers++;
+    else {
+      fprintf(stderr, "Usage: %s [-1] [-c] [-r]\n", *argv);
+      exit(1);
+    }
+  }
+  static char buf[1 << 16];
+  setvbuf(stdout, buf, _IOFBF, sizeof(buf));
+
+  char *line = 0;
+  size_t len = 0;
+  int lineno = 0;
+  // Returns the next line that is neither blank nor a comment, or NULL.
+  char *next_line() {
+    for (ssize_t n; -1 != (n = getline(&line, &len, stdin));) {
+      lineno++;
+      if (n && line[n - 1] == '\n') line[--n] = 0;
+      char *s = line + strspn(line, " \t\r");
+      if (*s && *s != '|') return s;
+    }
+    return 0;
+  }
+  // Splits a line into words in place, and calls f on each.
+  void forall_word(char *s, void f(char *)) {
+    for (char *w; (w = strsep(&s, " \t\r"));) if (*w) f(w);
+  }
+
+  struct intern_s items = {0}, colors = {0};
+  int nprimary = -1;
+  dlx_t dlx = dlx_new();
+  char *s = next_line();
+  if (!s) die("no items");
+  void add_item(char *w) {
+    if (!strcmp(w, "|")) {
+      if (nprimary >= 0) die("line %d: more than one '|'", lineno);
+      nprimary = items.n;
+      return;
+    }
+    int lo = -1, hi = -1;
+    char *bar = strchr(w, '|');
+    if (bar) {
+      if (nprimary >= 0) {
+        die("line %d: multiplicity of secondary item %s", lineno, w);
+      }
+      *bar = 0;
+      char *end;
+      lo = hi = strtol(w, &end, 10);
+      if (*end == ':') hi = strtol(end + 1, &end, 10);
+      if (end == w || *end) die("line %d: bad multiplicity %s", lineno, w);
+      w = bar + 1;
+    }
+    if (!*w || strchr(w, ':') || strchr(w, '|')) {
+      die("line %d: bad item name %s", lineno, w);
+    }
+    if (intern(&items, w, 0) >= 0) die("line %d: duplicate item %s", lineno, w);
+    int col = intern(&items, w, 1);
+    if (bar && dlx_set_bounds(dlx, col, lo, hi)) {
+      die("line %d: bad multiplicity for %s", lineno, w);
+    }
+    if (nprimary >= 0) dlx_mark_optional(dlx, col);
+  }
+  forall_word(s, add_item);
+  if (nprimary < 0) nprimary = items.n;
+  if (!nprimary) die("no primary items");
+
+  // Options, and unless printing numbers, their text as offsets into 'text'.
+  int *cols = malloc(sizeof(int) * items.n);
+  int *color = malloc(sizeof(int) * items.n);
+  int *seen = malloc(sizeof(int) * items.n);
+  F(i, items.n) seen[i] = -1;
+  char *text = 0;
+  size_t textn = 0, textmax = 0, *start = 0;
+  int rows = 0, maxrows = 0, n;
+  void add_cell(char *w) {
+    char *colon = strchr(w, ':');
+    if (colon) *colon = 0;
+    int col = intern(&items, w, 0);
+    if (col < 0) die("line %d: unknown item %s", lineno, w);
+    if (seen[col] == rows) die("line %d: repeated item %s", lineno, w);
+    seen[col] = rows;
+    color[n] = 0;
+    if (colon) {
+      if (col < nprimary) die("line %d: color on primary item %s", lineno, w);
+      if (!colon[1]) die("line %d: empty color for %s", lineno, w);
+      color[n] = 1 + intern(&colors, colon + 1, 1);
+      *colon = ':';
+    }
+    cols[n++] = col;
+  }
+  while ((s = next_line())) {
+    if (!numbers) {
+      size_t k = strlen(s) + 1;
+      while (textn + k > textmax) {
+        text = realloc(text, textmax = 2*textmax + 4096);
+      }
+      memcpy(text + textn, s, k);
+      if (rows == maxrows) {
+        maxrows = 2*maxrows + 1024;
+        start = realloc(start, sizeof(*start) * maxrows);
+      }
+      start[rows] = textn;
+      textn += k;
+    }
+    n = 0;
+    forall_word(s, add_cell);
+    if (n) {
+      dlx_add_row(dlx, cols, n);
+      F(i, n) if (color[i]) dlx_set_color(dlx, rows, cols[i], color[i]);
+      rows++;
+    }
+  }
+  free(line);
+
+  // Columns are only made once some option or call mentions them. A primary
+  // item past the last column is in no option, and has no multiplicity that
+  // lets it go uncovered, so there are no solutions.
+  int possible = dlx_cols(dlx) >= nprimary;
+  void print(int row[], int n) {
+    if (numbers) F(i, n) printf(i ? " %d" : "%d", row[i]);
+    else F(i, n) puts(text + start[row[i]]);
+    putchar('\n');
+  }
+  if (!possible) {
+    if (count_only) puts("0");
+  } else if (count_only) {
+    printf("%lld\n", (long long) dlx_count_covers(dlx, first));
+  } else if (first) {
+    dlx_first_cover(dlx, print);
+  } else {
+    dlx_forall_cover(dlx, print);
+  }
+  dlx_clear(dlx);
+  intern_clear(&items);
+  intern_clear(&colors);
+  free(cols), free(color), free(seen), free(text), free(start);
+  return 0;
+}
@@ -3,12 +3,21 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
+#include <unistd.h>
 #include "dlx.h"
 
 #define F(i,n) for(int i = 0; i < n; i++)
 
 #define EXPECT(X) if (!(X)) die("FAIL: line %d: %s", __LINE__, #X)
 
+// Checks of search counters, which are compiled out by -DDLX_NO_STATS. The
+// condition is still parsed, so variables it reads count as used.
+#ifdef DLX_NO_STATS
+#define EXPECT_STAT(X) (void) sizeof(X)
+#else
+#define EXPECT_STAT(X) EXPECT(X)
+#endif
+
 static void die(const char *err, ...) {
   va_list params;
   va_start(params, err);
@@ -50,6 +59,31 @@ void parse_sudoku(int grid[9][9], char *s) {
   }
 }
 
+// Returns the sudoku constraint matrix, where row ((n*9) + r)*9 + c means
+// digit n + 1 lies in row r and column c.
+static dlx_t new_sudoku_dlx() {
+  dlx_t dlx = dlx_new();
+  int nine(int a, int b, int c) { return ((a * 9) + b) * 9 + c; }
+  F(n, 9) F(r, 9) F(c, 9) {
+    int row = nine(n, r, c);
+    dlx_set(dlx, row, nine(0, r, c));
+    dlx_set(dlx, row, nine(1, n, r));
+    dlx_set(dlx, row, nine(2, n, c));
+    dlx_set(dlx, row, nine(3, n, r / 3 * 3 + c / 3));
+  }
+  return dlx;
+}
+
+// Fills in all but the first three rows of the solved sudoku, leaving 276
+// ways to complete the grid.
+static void pick_sudoku_bottom(dlx_t dlx) {
+  int grid[9][9];
+  parse_sudoku(grid, sudoku17_1_solved);
+  for (int r = 3; r < 9; r++) F(c, 9) {
+    dlx_pick_row(dlx, ((grid[r][c] - 1) * 9 + r) * 9 + c);
+  }
+}
+
 static void test_sudoku() {
   int grid[9][9];
   parse_sudoku(grid, sudoku17_1);
@@ -242,6 +276,270 @@ void test_perm() {
   dlx_clear(dlx);
 }
 
+void test_count_covers() {
+  dlx_t dlx = dlx_new();
+  F(i, 10) dlx_set(dlx, i, 0);
+  F(i, 3) dlx_set(dlx, 10 + i, 1);
+  EXPECT(30 == dlx_count_covers(dlx, 0));
+  EXPECT(2 == dlx_count_covers(dlx, 2));
+  EXPECT(30 == dlx_count_covers(dlx, 100));
+  // Stopping early must leave the matrix intact.
+  EXPECT(30 == dlx_count_covers(dlx, -1));
+  dlx_set(dlx, 12, 2);
+  EXPECT(10 == dlx_count_covers(dlx, 0));  // Row 12 is now compulsory.
+  dlx_mark_optional(dlx, 2);
+  EXPECT(30 == dlx_count_covers(dlx, 0));
+  dlx_clear(dlx);
+
+  dlx = new_sudoku_dlx();
+  pick_sudoku_bottom(dlx);
+  EXPECT(276 == dlx_count_covers(dlx, 0));
+  EXPECT(2 == dlx_count_covers(dlx, 2));
+  int count = 0;
+  void f(int row[], int n) { count++; }
+  dlx_forall_cover(dlx, f);
+  EXPECT(276 == count);
+  dlx_clear(dlx);
+}
+
+void test_first_cover() {
+  dlx_t dlx = dlx_new();
+  F(i, 10) dlx_set(dlx, i, 0);
+  F(i, 3) dlx_set(dlx, 10 + i, 1);
+  int count = 0;
+  void f(int r[], int n) {
+    EXPECT(n == 2);
+    EXPECT(r[0] == 10 && r[1] == 0);
+    count++;
+  }
+  EXPECT(1 == dlx_first_cover(dlx, f));
+  EXPECT(1 == count);
+  int g(int r[], int n) { return ++count == 6; }
+  EXPECT(5 == dlx_forall_cover_until(dlx, g));
+  // The search must have unwound cleanly.
+  EXPECT(30 == dlx_count_covers(dlx, 0));
+  dlx_set(dlx, 0, 2);
+  dlx_pick_row(dlx, 1);
+  EXPECT(0 == dlx_first_cover(dlx, f));
+  dlx_clear(dlx);
+}
+
+void test_iterative() {
+  // Both engines must visit the same solutions in the same order.
+  dlx_t dlx = dlx_new();
+  F(i, 4) F(j, 4) {
+    dlx_set(dlx, 4*i + j, i);
+    dlx_set(dlx, 4*i + j, 4 + j);
+  }
+  int want[24][4], k = 0;
+  void f(int r[], int n) {
+    EXPECT(n == 4);
+    F(i, 4) want[k][i] = r[i];
+    k++;
+  }
+  dlx_forall_cover(dlx, f);
+  EXPECT(24 == k);
+  dlx_set_engine(dlx, DLX_ITERATIVE);
+  k = 0;
+  void g(int r[], int n) {
+    EXPECT(n == 4);
+    F(i, 4) EXPECT(want[k][i] == r[i]);
+    k++;
+  }
+  dlx_forall_cover(dlx, g);
+  EXPECT(24 == k);
+  EXPECT(24 == dlx_count_covers(dlx, 0));
+  EXPECT(5 == dlx_count_covers(dlx, 5));
+  k = 0;
+  EXPECT(1 == dlx_first_cover(dlx, g));
+
+  // Interleave two paused searches on separate instances.
+  dlx_t other = dlx_new();
+  F(i, 10) dlx_set(other, i, 0);
+  F(i, 3) dlx_set(other, 10 + i, 1);
+  dlx_search_t s = dlx_search_new(dlx), t = dlx_search_new(other);
+  int *r, n;
+  F(i, 24) {
+    EXPECT(4 == dlx_search_next(s, &r));
+    F(j, 4) EXPECT(want[i][j] == r[j]);
+    EXPECT(2 == dlx_search_next(t, &r));
+    EXPECT(r[1] + 10*(r[0] - 10) == i);
+  }
+  EXPECT(-1 == dlx_search_next(s, &r));
+  EXPECT(-1 == dlx_search_next(s, &r));
+  dlx_search_clear(s);
+  // Abandon the other search halfway.
+  dlx_search_clear(t);
+  EXPECT(30 == dlx_count_covers(other, 0));
+  dlx_clear(other);
+
+  // The sudoku from before.
+  int grid[9][9];
+  parse_sudoku(grid, sudoku17_1);
+  dlx_t sud = dlx_new();
+  dlx_set_engine(sud, DLX_ITERATIVE);
+  int nine(int a, int b, int c) { return ((a * 9) + b) * 9 + c; }
+  F(n, 9) F(r, 9) F(c, 9) {
+    int row = nine(n, r, c);
+    dlx_set(sud, row, nine(0, r, c));
+    dlx_set(sud, row, nine(1, n, r));
+    dlx_set(sud, row, nine(2, n, c));
+    dlx_set(sud, row, nine(3, n, r / 3 * 3 + c / 3));
+  }
+  F(r, 9) F(c, 9) if (grid[r][c]) dlx_pick_row(sud, nine(grid[r][c] - 1, r, c));
+  s = dlx_search_new(sud);
+  EXPECT(81 - 17 == (n = dlx_search_next(s, &r)));
+  F(i, n) grid[r[i]/9%9][r[i]%9] = 1 + r[i]/9/9;
+  EXPECT(-1 == dlx_search_next(s, &r));
+  dlx_search_clear(s);
+  int sol[9][9];
+  parse_sudoku(sol, sudoku17_1_solved);
+  F(r, 9) F(c, 9) EXPECT(grid[r][c] == sol[r][c]);
+  dlx_clear(sud);
+  dlx_clear(dlx);
+}
+
+void test_parallel() {
+  dlx_t dlx = dlx_new();
+  // Permutations of 6 letters.
+  F(i, 6) F(j, 6) {
+    dlx_set(dlx, 6*i + j, i);
+    dlx_set(dlx, 6*i + j, 6 + j);
+  }
+  int count = 0, nthreads;
+  void f(int r[], int n, int thread) {
+    EXPECT(0 <= thread && thread < nthreads);
+    EXPECT(n == 6);
+    int used = 0;
+    F(i, n) used |= 1 << r[i]%6;
+    EXPECT(used == 63);
+    __atomic_fetch_add(&count, 1, __ATOMIC_RELAXED);
+  }
+  F(i, 4) {
+    nthreads = 1 << i;
+    count = 0;
+    EXPECT(720 == dlx_forall_cover_parallel(dlx, nthreads, f));
+    EXPECT(720 == count);
+    EXPECT(720 == dlx_forall_cover_parallel(dlx, nthreads, NULL));
+  }
+  EXPECT(720 == dlx_count_covers(dlx, 0));
+  // A row covering everything is a cover found above the cut.
+  F(j, 12) dlx_set(dlx, 36, j);
+  EXPECT(721 == dlx_forall_cover_parallel(dlx, 4, NULL));
+  dlx_clear(dlx);
+
+  dlx = new_sudoku_dlx();
+  pick_sudoku_bottom(dlx);
+  EXPECT(276 == dlx_forall_cover_parallel(dlx, 3, NULL));
+  EXPECT(276 == dlx_count_covers(dlx, 0));
+  dlx_clear(dlx);
+
+  // A matrix with no rows has exactly one cover: the empty one.
+  dlx = dlx_new();
+  EXPECT(1 == dlx_forall_cover_parallel(dlx, 2, NULL));
+  dlx_clear(dlx);
+}
+
+void test_clone_and_undo() {
+  dlx_t tmpl = new_sudoku_dlx();
+  int grid[9][9];
+  parse_sudoku(grid, sudoku17_1);
+  int nine(int a, int b, int c) { return ((a * 9) + b) * 9 + c; }
+
+  int mark = dlx_mark(tmpl);
+  EXPECT(0 == mark);
+  pick_sudoku_bottom(tmpl);
+  EXPECT(276 == dlx_count_covers(tmpl, 0));
+  dlx_undo(tmpl, mark);
+  F(r, 9) F(c, 9) if (grid[r][c]) {
+    dlx_pick_row(tmpl, nine(grid[r][c] - 1, r, c));
+  }
+  EXPECT(1 == dlx_count_covers(tmpl, 0));
+
+  // Undo only the picks after a checkpoint.
+  mark = dlx_mark(tmpl);
+  EXPECT(17 == mark);
+  // Contradict the solution: 9 at the top left.
+  dlx_pick_row(tmpl, nine(8, 0, 0));
+  EXPECT(0 == dlx_count_covers(tmpl, 0));
+  dlx_undo(tmpl, mark);
+  EXPECT(1 == dlx_count_covers(tmpl, 0));
+
+  // Clashing picks are refused.
+  EXPECT(-1 == dlx_pick_row(tmpl, nine(grid[0][7] - 1, 0, 7)));
+  EXPECT(-1 == dlx_pick_row(tmpl, nine(0, 0, 0)));
+  EXPECT(-1 == dlx_pick_row(tmpl, 9*9*9));
+  EXPECT(1 == dlx_count_covers(tmpl, 0));
+
+  // Removed rows come back too.
+  dlx_reset(tmpl);
+  F(n, 9) dlx_remove_row(tmpl, nine(n, 0, 0));
+  pick_sudoku_bottom(tmpl);
+  EXPECT(0 == dlx_count_covers(tmpl, 0));
+  dlx_reset(tmpl);
+  pick_sudoku_bottom(tmpl);
+  EXPECT(276 == dlx_count_covers(tmpl, 0));
+  dlx_reset(tmpl);
+
+  // Clones are independent of the template and of each other.
+  dlx_t x = dlx_clone(tmpl), y = dlx_clone(tmpl);
+  F(r, 9) F(c, 9) if (grid[r][c]) dlx_pick_row(x, nine(grid[r][c] - 1, r, c));
+  pick_sudoku_bottom(y);
+  dlx_t z = dlx_clone(y);
+  EXPECT(1 == dlx_count_covers(x, 0));
+  EXPECT(276 == dlx_count_covers(y, 0));
+  EXPECT(276 == dlx_count_covers(z, 0));
+  dlx_reset(z);
+  F(r, 9) F(c, 9) if (grid[r][c]) dlx_pick_row(z, nine(grid[r][c] - 1, r, c));
+  EXPECT(1 == dlx_count_covers(z, 0));
+  EXPECT(276 == dlx_count_covers(y, 0));
+  // Clones can still grow.
+  dlx_set(y, 9*9*9, 9*9*4);
+  dlx_mark_optional(y, 9*9*4);
+  EXPECT(276 == dlx_count_covers(y, 0));
+  EXPECT(dlx_cols(tmpl) + 1 == dlx_cols(y));
+  dlx_clear(x);
+  dlx_clear(y);
+  dlx_clear(z);
+  dlx_clear(tmpl);
+}
+
+void test_empty() {
+  dlx_t dlx = new_sudoku_dlx();
+  dlx_set_engine(dlx, DLX_ITERATIVE);
+  pick_sudoku_bottom(dlx);
+  EXPECT(276 == dlx_count_covers(dlx, 0));
+  EXPECT(0 == dlx_set_bounds(dlx, 0, 1, 2));
+
+  // Nothing is left, not even the picks and bounds.
+  dlx_empty(dlx);
+  EXPECT(0 == dlx_rows(dlx));
+  EXPECT(0 == dlx_cols(dlx));
+  EXPECT(1 == dlx_count_covers(dlx, 0));
+  dlx_set(dlx, 0, 0);
+  dlx_set(dlx, 1, 0);
+  dlx_set(dlx, 1, 1);
+  dlx_set(dlx, 2, 1);
+  EXPECT(2 == dlx_count_covers(dlx, 0));
+  EXPECT(0 == dlx_pick_row(dlx, 1));
+  EXPECT(1 == dlx_count_covers(dlx, 0));
+
+  // The same problem again, built in the same memory.
+  dlx_empty(dlx);
+  int nine(int a, int b, int c) { return ((a * 9) + b) * 9 + c; }
+  F(n, 9) F(r, 9) F(c, 9) {
+    int row = nine(n, r, c);
+    dlx_set(dlx, row, nine(0, r, c));
+    dlx_set(dlx, row, nine(1, n, r));
+    dlx_set(dlx, row, nine(2, n, c));
+    dlx_set(dlx, row, nine(3, n, r / 3 * 3 + c / 3));
+  }
+  pick_sudoku_bottom(dlx);
+  EXPECT(276 == dlx_count_covers(dlx, 0));
+  EXPECT_STAT(276 == dlx_stats(dlx)->solutions);
+  dlx_clear(dlx);
+}
+
 void test_readme_example() {
   // Initialize a new exact cover instance.
   dlx_t dlx = dlx_new();
@@ -281,12 +579,511 @@ void test_readme_example() {
   dlx_clear(dlx);
 }
 
+void test_stats() {
+  dlx_t dlx = dlx_new();
+  F(i, 10) dlx_set(dlx, i, 0);
+  F(i, 3) dlx_set(dlx, 10 + i, 1);
+  // Every search walks the same tree: the root, then a node per row of
+  // column 1, then one per row of column 0. Each cover removes one link.
+  void check() {
+    struct dlx_stats_s *st = dlx_stats(dlx);
+#ifdef DLX_NO_STATS
+    // Nothing is counted.
+    EXPECT(!st->nodes && !st->updates && !st->solutions && !st->max_depth);
+    EXPECT(!st->profile[0] && !st->seconds);
+#else
+    EXPECT(34 == st->nodes);
+    EXPECT(4 == st->updates);
+    EXPECT(30 == st->solutions);
+    EXPECT(2 == st->max_depth);
+    EXPECT(1 == st->profile[0] && 3 == st->profile[1] && 30 == st->profile[2]);
+    EXPECT(st->seconds >= 0);
+#endif
+  }
+  void f(int row[], int n) {}
+  dlx_forall_cover(dlx, f);
+  check();
+  EXPECT(30 == dlx_count_covers(dlx, 0));
+  check();
+  EXPECT(30 == dlx_forall_cover_parallel(dlx, 2, 0));
+  check();
+  dlx_set_engine(dlx, DLX_ITERATIVE);
+  dlx_forall_cover(dlx, f);
+  check();
+  // Counters start afresh with each search.
+  EXPECT(1 == dlx_first_cover(dlx, f));
+  EXPECT_STAT(3 == dlx_stats(dlx)->nodes);
+  EXPECT_STAT(1 == dlx_stats(dlx)->solutions);
+  dlx_clear(dlx);
+}
+
+void test_estimate() {
+  // The tree of test_stats() has uniform branching, so each probe is exact.
+  dlx_t dlx = dlx_new();
+  F(i, 10) dlx_set(dlx, i, 0);
+  F(i, 3) dlx_set(dlx, 10 + i, 1);
+  double covers;
+  EXPECT(34 == dlx_estimate(dlx, 5, 1, &covers));
+  EXPECT(30 == covers);
+  EXPECT(30 == dlx_count_covers(dlx, 0));
+  // Progress only grows, and the last report is on the last node.
+  double last = -1;
+  int calls = 0;
+  void f(double x) {
+    EXPECT(x >= last && x < 1);
+    last = x;
+    calls++;
+  }
+  int g(int row[], int n) { return 0; }
+  dlx_set_progress(dlx, 1, f);
+  EXPECT(30 == dlx_forall_cover_until(dlx, g));
+  EXPECT(34 == calls);
+  EXPECT(1 - 1.0/30 - 1e-9 < last);
+  dlx_clear(dlx);
+
+  dlx = new_sudoku_dlx();
+  pick_sudoku_bottom(dlx);
+  double nodes = dlx_estimate(dlx, 1000, 1, &covers);
+  EXPECT(276 == dlx_count_covers(dlx, 0));
+  // Rough agreement with the real counts.
+  EXPECT(covers > 276 / 4 && covers < 276 * 4);
+  EXPECT_STAT(nodes > dlx_stats(dlx)->nodes / 4 &&
+              nodes < dlx_stats(dlx)->nodes * 4);
+  dlx_clear(dlx);
+}
+
+void test_colors() {
+  // Knuth's example: primary columns p, q, r = 0, 1, 2, and secondary
+  // columns x, y = 3, 4, with colors A = 1 and B = 2. The rows are
+  // "p q x y:A", "p r x:A y", "p x:B", "q x:A", "r y:B", and "x:B".
+  dlx_t dlx = dlx_new();
+  dlx_mark_optional(dlx, 3);
+  dlx_mark_optional(dlx, 4);
+  dlx_set(dlx, 0, 0); dlx_set(dlx, 0, 1); dlx_set(dlx, 0, 3);
+  dlx_set_color(dlx, 0, 4, 1);
+  dlx_set(dlx, 1, 0); dlx_set(dlx, 1, 2); dlx_set_color(dlx, 1, 3, 1);
+  dlx_set(dlx, 1, 4);
+  dlx_set(dlx, 2, 0); dlx_set_color(dlx, 2, 3, 2);
+  dlx_set(dlx, 3, 1); dlx_set_color(dlx, 3, 3, 1);
+  dlx_set(dlx, 4, 2); dlx_set_color(dlx, 4, 4, 2);
+  dlx_set_color(dlx, 5, 3, 2);
+  int count = 0;
+  void f(int row[], int n) {
+    EXPECT(2 == n);
+    EXPECT((1 << row[0] | 1 << row[1]) == (1 << 1 | 1 << 3));
+    count++;
+  }
+  dlx_forall_cover(dlx, f);
+  EXPECT(1 == count);
+  EXPECT(1 == dlx_count_covers(dlx, 0));
+  dlx_set_engine(dlx, DLX_ITERATIVE);
+  dlx_forall_cover(dlx, f);
+  EXPECT(2 == count);
+  EXPECT(1 == dlx_forall_cover_parallel(dlx, 2, 0));
+
+  // Picks must agree on colors.
+  EXPECT(!dlx_pick_row(dlx, 3));
+  EXPECT(-1 == dlx_pick_row(dlx, 2));
+  EXPECT(-1 == dlx_pick_row(dlx, 5));
+  EXPECT(1 == dlx_count_covers(dlx, 0));
+  dlx_reset(dlx);
+  EXPECT(!dlx_pick_row(dlx, 5));
+  EXPECT(0 == dlx_count_covers(dlx, 0));
+  dlx_reset(dlx);
+  dlx_clear(dlx);
+
+  // Rows sharing a color can all be chosen together.
+  dlx = dlx_new();
+  F(i, 3) dlx_set(dlx, i, i), dlx_set_color(dlx, i, 3, 7);
+  EXPECT(1 == dlx_count_covers(dlx, 0));
+  dlx_set_color(dlx, 2, 3, 8);
+  EXPECT(0 == dlx_count_covers(dlx, 0));
+  dlx_clear(dlx);
+}
+
+void test_bounds() {
+  // Three shifts each need 2 to 3 of 4 staff, who each work one shift.
+  dlx_t dlx = dlx_new();
+  F(s, 3) dlx_set_bounds(dlx, s, 2, 3);
+  F(p, 4) F(s, 3) dlx_set(dlx, 3*p + s, s), dlx_set(dlx, 3*p + s, 3 + p);
+  // No way to staff 3 shifts with 2 each from 4 people.
+  EXPECT(0 == dlx_count_covers(dlx, 0));
+  dlx_clear(dlx);
+  // With 6 staff: choose which 2 staff go to each shift.
+  dlx = dlx_new();
+  F(s, 3) dlx_set_bounds(dlx, s, 2, 3);
+  F(p, 6) F(s, 3) dlx_set(dlx, 3*p + s, s), dlx_set(dlx, 3*p + s, 3 + p);
+  EXPECT(15 * 6 == dlx_count_covers(dlx, 0));
+  EXPECT(15 * 6 == dlx_forall_cover_parallel(dlx, 2, 0));
+  EXPECT(-1 == dlx_set_bounds(dlx, 0, 2, 1));
+  EXPECT(-1 == dlx_set_bounds(dlx, 0, 0, 0));
+  dlx_clear(dlx);
+
+  // Compare with brute force on random small instances, with some optional
+  // and colored columns.
+  srand(1);
+  F(iter, 300) {
+    int rows = 1 + rand() % 10, cols = 1 + rand() % 5;
+    int m[rows][cols], lo[cols], hi[cols], opt[cols];
+    dlx = dlx_new();
+    F(c, cols) {
+      opt[c] = rand() % 4 == 0;
+      hi[c] = 1 + rand() % 3;
+      lo[c] = opt[c] ? 0 : rand() % (hi[c] + 1);
+      if (opt[c]) dlx_mark_optional(dlx, c);
+      EXPECT(!dlx_set_bounds(dlx, c, lo[c], hi[c]));
+    }
+    // m[r][c] is 0 for no 1, 1 for a plain 1, or 1 plus its color.
+    F(r, rows) F(c, cols) if ((m[r][c] = rand() % 3 == 0)) {
+      // Colors only for optional columns of at most one row.
+      if (opt[c] && hi[c] == 1 && rand() % 2) m[r][c] += 1 + rand() % 2;
+      if (m[r][c] > 1) dlx_set_color(dlx, r, c, m[r][c] - 1);
+      else dlx_set(dlx, r, c);
+    }
+    int64_t want = 0;
+    // Rows without a 1 in a primary column are never chosen.
+    int idle = 0;
+    F(r, rows) {
+      int n = 0;
+      F(c, cols) n += m[r][c] && !opt[c];
+      if (!n) idle |= 1 << r;
+    }
+    F(set, 1 << rows) if (!(set & idle)) {
+      int ok = 1;
+      F(c, cols) {
+        int n = 0, plain = 0, color = 0;
+        F(r, rows) if (set >> r & 1 && m[r][c]) {
+          n++;
+          if (m[r][c] == 1) plain++;
+          else if (color && color != m[r][c]) ok = 0;
+          else color = m[r][c];
+        }
+        if (color) ok &= !plain;
+        else ok &= lo[c] <= n && n <= hi[c];
+      }
+      want += ok;
+    }
+    EXPECT(want == dlx_count_covers(dlx, 0));
+    int64_t got = 0;
+    void f(int row[], int n) {
+      // Distinct rows, in no particular order.
+      F(i, n) F(j, i) EXPECT(row[i] != row[j]);
+      got++;
+    }
+    dlx_forall_cover(dlx, f);
+    EXPECT(want == got);
+    dlx_clear(dlx);
+  }
+}
+
+void test_heuristics() {
+  // Every rule finds the same covers, whatever the order.
+  // Smallest column, ties to the last.
+  int score(int col, int size) { return size * 1000 - col; }
+  F(h, DLX_BUCKETS + 1) F(engine, 2) {
+    dlx_t dlx = new_sudoku_dlx();
+    pick_sudoku_bottom(dlx);
+    dlx_set_engine(dlx, engine);
+    dlx_set_heuristic(dlx, h);
+    if (h == DLX_SCORE) dlx_set_score(dlx, score);
+    F(c, dlx_cols(dlx)) dlx_set_weight(dlx, c, c % 7);
+    dlx_set_seed(dlx, 42);
+    EXPECT(276 == dlx_count_covers(dlx, 0));
+    int count = 0;
+    void f(int row[], int n) { EXPECT(n == 27); count++; }
+    dlx_forall_cover(dlx, f);
+    EXPECT(276 == count);
+    EXPECT(276 == dlx_count_covers(dlx, 0));
+    dlx_clear(dlx);
+  }
+
+  // Buckets with colors.
+  dlx_t dlx = dlx_new();
+  dlx_set_heuristic(dlx, DLX_BUCKETS);
+  F(i, 4) dlx_set(dlx, i, i), dlx_set_color(dlx, i, 4, 1 + i % 2);
+  F(i, 4) dlx_set(dlx, 4 + i, i);
+  // Each column i < 4 takes row i or row 4 + i; the colored rows must agree.
+  EXPECT(1 + 2 + 2 + 2 == dlx_count_covers(dlx, 0));
+
+  // Ties between columns of size 1 go to the heaviest.
+  dlx_clear(dlx);
+  dlx = dlx_new();
+  F(i, 3) dlx_set(dlx, i, i);
+  dlx_set_weight(dlx, 1, 5);
+  dlx_set_heuristic(dlx, DLX_MRV_WEIGHT);
+  int first = -1;
+  void g(int row[], int n) { first = row[0]; }
+  dlx_forall_cover(dlx, g);
+  EXPECT(1 == first);
+  dlx_clear(dlx);
+}
+
+void test_add_row() {
+  // The sudoku of new_sudoku_dlx(), a row at a time.
+  dlx_t dlx = dlx_new();
+  F(d, 9) F(r, 9) F(c, 9) {
+    int cols[] = {
+      9*r + c, 81 + 9*r + d, 162 + 9*c + d, 243 + 9*(r/3*3 + c/3) + d,
+      9*r + c,  // Repeats are ignored.
+    };
+    EXPECT(81*d + 9*r + c == dlx_add_row(dlx, cols, 5));
+  }
+  EXPECT(729 == dlx_rows(dlx));
+  EXPECT(324 == dlx_cols(dlx));
+  pick_sudoku_bottom(dlx);
+  EXPECT(276 == dlx_count_covers(dlx, 0));
+  int bad[] = {1, -1};
+  EXPECT(-1 == dlx_add_row(dlx, bad, 2));
+  EXPECT(729 == dlx_rows(dlx));
+  dlx_clear(dlx);
+
+  // And from compressed sparse rows.
+  int row_ptr[730], col_idx[729*4];
+  F(d, 9) F(r, 9) F(c, 9) {
+    int i = 81*d + 9*r + c, *x = col_idx + 4*i;
+    row_ptr[i] = 4*i;
+    x[0] = 9*r + c, x[1] = 81 + 9*r + d;
+    x[2] = 162 + 9*c + d, x[3] = 243 + 9*(r/3*3 + c/3) + d;
+  }
+  row_ptr[729] = 729*4;
+  dlx = dlx_from_csr(729, 0, row_ptr, col_idx);
+  EXPECT(324 == dlx_cols(dlx));
+  pick_sudoku_bottom(dlx);
+  EXPECT(276 == dlx_count_covers(dlx, 0));
+  dlx_clear(dlx);
+  EXPECT(!dlx_from_csr(729, 0, row_ptr, (col_idx[5] = -1, col_idx)));
+}
+
+void test_save_load() {
+  char name[] = "/tmp/dlx_testXXXXXX";
+  close(mkstemp(name));
+
+  // A sudoku with some rows removed and some picked.
+  dlx_t dlx = new_sudoku_dlx();
+  int grid[9][9];
+  parse_sudoku(grid, sudoku17_1_solved);
+  // Only the solution's digit may go in the top left cell.
+  F(n, 9) if (n != grid[0][0] - 1) dlx_remove_row(dlx, 81*n);
+  pick_sudoku_bottom(dlx);
+  int64_t want = dlx_count_covers(dlx, 0);
+  EXPECT(0 < want && want <= 276);
+  EXPECT(!dlx_save(dlx, name));
+  dlx_t copy = dlx_load(name);
+  EXPECT(copy);
+  EXPECT(dlx_rows(copy) == dlx_rows(dlx) && dlx_cols(copy) == dlx_cols(dlx));
+  EXPECT(want == dlx_count_covers(copy, 0));
+  EXPECT(dlx_mark(copy) == dlx_mark(dlx));
+  // The trail comes along, so the loaded copy can be reset too.
+  dlx_reset(copy);
+  pick_sudoku_bottom(copy);
+  EXPECT(276 == dlx_count_covers(copy, 0));
+  dlx_clear(copy);
+  dlx_clear(dlx);
+
+  // Optional columns, colors and bounds.
+  dlx = dlx_new();
+  F(s, 3) dlx_set_bounds(dlx, s, 2, 3);
+  F(p, 6) F(s, 3) {
+    dlx_set(dlx, 3*p + s, s);
+    dlx_set(dlx, 3*p + s, 3 + p);
+    dlx_set_color(dlx, 3*p + s, 9, 1 + p % 2);
+  }
+  dlx_mark_optional(dlx, 10);
+  want = dlx_count_covers(dlx, 0);
+  EXPECT(!dlx_save(dlx, name));
+  copy = dlx_load(name);
+  EXPECT(want == dlx_count_covers(copy, 0));
+  dlx_clear(copy);
+  dlx_clear(dlx);
+
+  // Rows {0} and {0, 1}, where column 1 is optional and colored in row 1.
+  // Picking row 0 then removing row 1 replays, but picking both clashes,
+  // and a color in a primary column is refused.
+  int32_t bin[] = {
+    2, 2, 3, 2,  // Rows, columns, cells, trail.
+    0, 1,  1, 1,  1, 1,  // Optional, lo, hi.
+    0, 1, 3,  0, 0, 1,  0, 0, 1,  // Rows, columns and colors of the cells.
+    0, -2,  // Trail.
+  };
+  int load_bin() {
+    FILE *fp = fopen(name, "wb");
+    fputs("DLXBIN1", fp);
+    fputc(0, fp);
+    fwrite(bin, sizeof(bin), 1, fp);
+    fclose(fp);
+    dlx_t p = dlx_load(name);
+    if (p) dlx_clear(p);
+    return !!p;
+  }
+  EXPECT(load_bin());
+  bin[20] = 1;
+  EXPECT(!load_bin());
+  bin[20] = -2, bin[5] = 0;
+  EXPECT(!load_bin());
+
+  // Malformed or missing files.
+  FILE *fp = fopen(name, "wb");
+  fputs("DLXBIN1", fp);
+  fputc(0, fp);
+  F(i, 4) fwrite(&(int){-1}, sizeof(int), 1, fp);
+  fclose(fp);
+  EXPECT(!dlx_load(name));
+  remove(name);
+  EXPECT(!dlx_load(name));
+}
+
+void test_zdd() {
+  dlx_t dlx = new_sudoku_dlx();
+  pick_sudoku_bottom(dlx);
+  dlx_zdd_t zdd = dlx_zdd(dlx);
+  EXPECT(276 == dlx_zdd_count(zdd));
+  EXPECT(0 < dlx_zdd_nodes(zdd));
+  // Samples are covers of what is left of the grid.
+  int rows[324];
+  F(seed, 10) {
+    int n = dlx_zdd_sample(zdd, seed, rows), mark = dlx_mark(dlx);
+    EXPECT(27 == n);
+    F(i, n) EXPECT(!dlx_pick_row(dlx, rows[i]));
+    EXPECT(1 == dlx_count_covers(dlx, 0));
+    dlx_undo(dlx, mark);
+  }
+  dlx_zdd_clear(zdd);
+  dlx_clear(dlx);
+
+  // The partitions of a 4-set: a row for each nonempty subset.
+  dlx = dlx_new();
+  F(r, 15) F(c, 4) if ((r + 1) >> c & 1) dlx_set(dlx, r, c);
+  zdd = dlx_zdd(dlx);
+  EXPECT(15 == dlx_zdd_count(zdd));
+  // Sampling is uniform: each partition should turn up about 1000 times.
+  int hist[1 << 15] = {0}, distinct = 0;
+  F(seed, 15000) {
+    int n = dlx_zdd_sample(zdd, seed, rows), set = 0;
+    F(i, n) set |= 1 << rows[i];
+    distinct += !hist[set]++;
+  }
+  EXPECT(15 == distinct);
+  F(set, 1 << 15) EXPECT(!hist[set] || (hist[set] > 800 && hist[set] < 1200));
+  // The heaviest partition, against brute force.
+  double w[15], want = -1e9, total;
+  F(r, 15) w[r] = (r * 7919) % 13 - 6;
+  void f(int sol[], int n) {
+    double sum = 0;
+    F(i, n) sum += w[sol[i]];
+    if (want < sum) want = sum;
+  }
+  dlx_forall_cover(dlx, f);
+  int n = dlx_zdd_best(zdd, w, rows, &total);
+  EXPECT(want == total);
+  F(i, n) total -= w[rows[i]];
+  EXPECT(0 == total);
+  dlx_zdd_clear(zdd);
+  dlx_clear(dlx);
+
+  // 8 queens, with optional diagonals.
+  dlx = dlx_new();
+  F(r, 8) F(c, 8) {
+    int cols[] = { r, 8 + c, 16 + r + c, 31 + r - c + 7 };
+    dlx_add_row(dlx, cols, 4);
+  }
+  F(i, 30) dlx_mark_optional(dlx, 16 + i);
+  zdd = dlx_zdd(dlx);
+  EXPECT(92 == dlx_zdd_count(zdd));
+  EXPECT_STAT(92 == dlx_stats(dlx)->solutions);
+  dlx_zdd_clear(zdd);
+  // With a queen at the top left, 4 ways.
+  dlx_pick_row(dlx, 0);
+  zdd = dlx_zdd(dlx);
+  EXPECT(4 == dlx_zdd_count(zdd));
+  dlx_zdd_clear(zdd);
+  // No covers.
+  dlx_reset(dlx);
+  F(c, 8) dlx_remove_row(dlx, c);
+  zdd = dlx_zdd(dlx);
+  EXPECT(0 == dlx_zdd_count(zdd));
+  EXPECT(-1 == dlx_zdd_sample(zdd, 0, rows));
+  EXPECT(-1 == dlx_zdd_best(zdd, w, rows, 0));
+  dlx_zdd_clear(zdd);
+  dlx_clear(dlx);
+
+  // Colors and bounds are refused.
+  dlx = dlx_new();
+  dlx_set(dlx, 0, 0);
+  dlx_set_color(dlx, 0, 1, 1);
+  EXPECT(!dlx_zdd(dlx));
+  dlx_clear(dlx);
+  dlx = dlx_new();
+  dlx_set(dlx, 0, 0);
+  dlx_set_bounds(dlx, 0, 0, 1);
+  EXPECT(!dlx_zdd(dlx));
+  dlx_clear(dlx);
+}
+
+void test_cache() {
+  dlx_t dlx = new_sudoku_dlx();
+  pick_sudoku_bottom(dlx);
+  dlx_set_cache(dlx, 1 << 20);
+  EXPECT(276 == dlx_count_covers(dlx, 0));
+  EXPECT(10 == dlx_count_covers(dlx, 10));
+  dlx_clear(dlx);
+
+  // The partitions of a 6-set, where the same subproblems come up often.
+  dlx = dlx_new();
+  F(r, 63) F(c, 6) if ((r + 1) >> c & 1) dlx_set(dlx, r, c);
+  EXPECT(203 == dlx_count_covers(dlx, 0));
+  int64_t nodes = dlx_stats(dlx)->nodes;
+  EXPECT(!dlx_stats(dlx)->cache_hits);
+  dlx_set_cache(dlx, 1 << 20);
+  EXPECT(203 == dlx_count_covers(dlx, 0));
+  EXPECT_STAT(dlx_stats(dlx)->cache_hits > 0);
+  EXPECT_STAT(dlx_stats(dlx)->nodes < nodes);
+  // Hits are capped by the maximum.
+  EXPECT(100 == dlx_count_covers(dlx, 100));
+  // A cache of one set, which is always full.
+  dlx_set_cache(dlx, 200);
+  EXPECT(203 == dlx_count_covers(dlx, 0));
+  EXPECT_STAT(dlx_stats(dlx)->cache_hits > 0);
+  // Too small for any.
+  dlx_set_cache(dlx, 10);
+  EXPECT(203 == dlx_count_covers(dlx, 0));
+  EXPECT(!dlx_stats(dlx)->cache_hits);
+  dlx_clear(dlx);
+
+  // No cache with colors: the example of test_colors().
+  dlx = dlx_new();
+  dlx_set_cache(dlx, 1 << 20);
+  dlx_set(dlx, 0, 0);
+  dlx_set_color(dlx, 0, 2, 1);
+  dlx_set(dlx, 1, 1);
+  dlx_set_color(dlx, 1, 2, 2);
+  dlx_set(dlx, 2, 1);
+  dlx_set_color(dlx, 2, 2, 1);
+  EXPECT(1 == dlx_count_covers(dlx, 0));
+  EXPECT(!dlx_stats(dlx)->cache_hits);
+  dlx_clear(dlx);
+}
+
 int main() {
   test_sudoku();
   test_sudoku_duplicate_constraints();
   test_sudoku_random_order();
   test_counter();
   test_perm();
+  test_count_covers();
+  test_first_cover();
+  test_iterative();
+  test_parallel();
+  test_clone_and_undo();
+  test_stats();
+  test_estimate();
+  test_colors();
+  test_bounds();
+  test_heuristics();
+  test_add_row();
+  test_save_load();
+  test_zdd();
+  test_cache();
+  test_empty();
   test_readme_example();
   return 0;
 }
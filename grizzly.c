@@ -1,7 +1,14 @@
 // = Grizzly =
 //
-// Solves logic grid puzzles. By default, uses the DLX agorithm, but
-// uses brute force if --alg=brute is given on the command-line.
+// Solves logic grid puzzles. By default, uses the DLX agorithm, with
+// whichever of the two encodings below makes for the smaller matrix, but
+// --alg=per_col_dlx or --alg=per_cell_dlx picks one, and --alg=brute uses
+// brute force instead.
+// Stops after the first solution if --first is given. With --stats, reports
+// search statistics of the DLX algorithms on standard error. With
+// --threads=N, runs brute force, or builds the per_col_dlx matrix, on N
+// threads. With --batch, solves many puzzles, separated by "%%" lines, on
+// N threads, and prints how many solutions each has.
 //
 // We view a logic grid puzzle as follows. Given a MxN table of distinct
 // symbols and some constraints, for each row except the first, we are to
@@ -11,12 +18,16 @@
 // DLX-rows and DLX-columns.
 
 #define _GNU_SOURCE
+#include <pthread.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <getopt.h>
-#include "blt.h"
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 #include "dlx.h"
 
 #define F(i, n) for(int i=0; i<n; i++)
@@ -35,6 +46,46 @@ void die(const char *err, ...) {
   exit(1);
 }
 
+// Set by --first: stop after printing one solution.
+int first_only;
+// Set by --stats: report search statistics.
+int show_stats;
+// Set by --batch: solve many puzzles, reporting how many solutions each has.
+int batch;
+// Set by --threads: threads for brute force and for building the
+// per_col_dlx matrix. Defaults to the number of processors online.
+int nthreads = 1;
+
+// Where the solutions of a puzzle go. In batch mode, a run is reused from
+// one puzzle to the next, so its matrix keeps its memory.
+struct run_s {
+  FILE *out;  // Solutions are printed here, unless NULL.
+  int64_t solutions;  // Counted whether printed or not.
+  int threads;  // For brute force and for building the per_col_dlx matrix.
+  int stats;  // Whether to report search statistics.
+  dlx_t dlx;  // Emptied for each puzzle.
+};
+typedef struct run_s *run_t;
+
+void print_stats(run_t run, dlx_t dlx) {
+  if (!run->stats) return;
+  struct dlx_stats_s *st = dlx_stats(dlx);
+  fprintf(stderr, "%d DLX-rows, %d DLX-columns\n",
+          dlx_rows(dlx), dlx_cols(dlx));
+  fprintf(stderr, "%lld nodes, %lld updates, %lld solutions, %.6fs\n",
+          (long long) st->nodes, (long long) st->updates,
+          (long long) st->solutions, st->seconds);
+  F(l, st->max_depth + 1) {
+    fprintf(stderr, "depth %d: %lld nodes\n", l, (long long) st->profile[l]);
+  }
+}
+
+double now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
 void swap_int(int *x, int *y) { int tmp = *x; *x = *y, *y = tmp; }
 
 void forall_word(char *s, void f(char *)) {
@@ -47,18 +98,86 @@ void forall_word(char *s, void f(char *)) {
   }
 }
 
-char *mallocgets() {
-  char *s = 0;
-  size_t len = 0;
-  if (-1 == getline(&s, &len, stdin)) {
-    free(s);
-    return 0;
+// Reads all of standard input into one buffer, ending with a NUL. Lines and
+// words are then cut out of it in place.
+char *read_all() {
+  size_t n = 0, max = 1 << 16;
+  struct stat st;
+  if (!fstat(0, &st) && S_ISREG(st.st_mode)) max = st.st_size + 2;
+  char *buf = malloc(max);
+  for (ssize_t k; (k = read(0, buf + n, max - 1 - n)) > 0;) {
+    n += k;
+    if (n + 1 == max) buf = realloc(buf, max *= 2);
   }
-  // Assumes newline before EOF.
-  s[strlen(s) - 1] = 0;
+  buf[n] = 0;
+  return buf;
+}
+
+// Returns the line at *p, cut off at its newline, and moves *p past it.
+// Returns NULL at the end of the input.
+char *next_line(char **p) {
+  char *s = *p;
+  if (!*s) return 0;
+  char *e = strchrnul(s, '\n');
+  *p = *e ? e + 1 : e;
+  if (e > s && e[-1] == '\r') e--;
+  *e = 0;
   return s;
 }
 
+// Symbols, in an open addressing table. Names point into the input.
+struct symtab_s {
+  struct {
+    char *key;  // NULL when empty.
+    int coord[2];
+  } *slot;
+  int cap, n;
+};
+typedef struct symtab_s *symtab_t;
+
+uint32_t hash(const char *s) {
+  uint32_t h = 2166136261u;
+  for (; *s; s++) h = (h ^ (unsigned char) *s) * 16777619u;
+  return h;
+}
+
+// Returns the slot holding the given name, or the empty slot it would go in.
+int slot_of(symtab_t t, const char *s) {
+  uint32_t i = hash(s) & (t->cap - 1);
+  while (t->slot[i].key && strcmp(t->slot[i].key, s)) {
+    i = (i + 1) & (t->cap - 1);
+  }
+  return i;
+}
+
+// Returns the coordinates of the given symbol, or NULL if there is none.
+int *sym_get(symtab_t t, const char *s) {
+  if (!t->cap) return 0;
+  int i = slot_of(t, s);
+  return t->slot[i].key ? t->slot[i].coord : 0;
+}
+
+// Adds a symbol at row m and column n. Returns 0 on success, or -1 if the
+// name is taken. Keeps the table at most half full.
+int sym_add(symtab_t t, char *s, int m, int n) {
+  if (2 * (t->n + 1) > t->cap) {
+    struct symtab_s old = *t;
+    t->cap = old.cap ? 2 * old.cap : 64;
+    t->slot = calloc(t->cap, sizeof(*t->slot));
+    F(i, old.cap) if (old.slot[i].key) {
+      t->slot[slot_of(t, old.slot[i].key)] = old.slot[i];
+    }
+    free(old.slot);
+  }
+  int i = slot_of(t, s);
+  if (t->slot[i].key) return -1;
+  t->slot[i].key = s;
+  t->slot[i].coord[0] = m;
+  t->slot[i].coord[1] = n;
+  t->n++;
+  return 0;
+}
+
 struct hint_s {
   char cmd;  // Type of clue.
   int (*coord)[2], n, coord_max;  // Arguments of clue.
@@ -66,102 +185,267 @@ struct hint_s {
 };
 typedef struct hint_s *hint_ptr;
 
-// Solves using brute force.
-void brute(int M, int N, char *sym[M][N], int hint_n, hint_ptr *hint) {
-  // For each row except the first, generate all permutations.
-  int perm[M-1][N];
-  F(m, M-1) F(n, N) perm[m][n] = n;
-  void f(int m) {
-    if (m == M-1) {
-      // Base case: see if solution works.
-      int check(hint_ptr h) {
-        int get(int m, int n) { return m ? perm[m-1][n] : n; }
-        int has(int i, int n) { return get(h->coord[i][0], n) == h->coord[i][1]; }
-        int matchmax() {
+// A parsed puzzle. Parsing another puzzle into it reuses its buffers: the
+// symbol table, the table of symbols, and the hints, of which the first
+// 'hint_made' have been allocated.
+struct puzzle_s {
+  int M, N, sym_max;
+  char **sym;  // sym[m*N + n] is the symbol at row m and column n.
+  struct symtab_s tab;
+  int hint_n, hint_max, hint_made;
+  hint_ptr *hint;
+};
+typedef struct puzzle_s *puzzle_t;
+
+// Parses a puzzle from the string s, cutting it up in place: M lines of N
+// space-delimited fields, terminated by "%%" on a single line by itself,
+// then a list of constraints, one per line.
+void parse(puzzle_t z, char *s) {
+  char *p = s;
+  symtab_t tab = &z->tab;
+  if (tab->cap) memset(tab->slot, 0, sizeof(*tab->slot) * tab->cap);
+  tab->n = 0;
+  int M = 0, N = 0;
+  for(;;) {
+    char *s = next_line(&p);
+    if (!s) die("expected %%%%");
+    if (!strcmp(s, "%%")) break;
+    int n = 0;
+    void f(char *s) {
+      if (sym_add(tab, s, M, n++)) die("duplicate symbol: %s", s);
+    }
+    forall_word(s, f);
+    if (!M) N = n; else if (N != n) die("line %d: wrong number of fields", M+1);
+    M++;
+  }
+  z->M = M, z->N = N;
+  if (z->sym_max < M*N) {
+    z->sym = realloc(z->sym, sizeof(*z->sym) * (z->sym_max = M*N));
+  }
+  F(i, tab->cap) if (tab->slot[i].key) {
+    z->sym[tab->slot[i].coord[0]*N + tab->slot[i].coord[1]] = tab->slot[i].key;
+  }
+
+  if (!z->hint) z->hint = NEW_ARRAY(z->hint, (z->hint_max = 64));
+  z->hint_n = 0;
+  for(char *s; (s = next_line(&p));) {
+    hint_ptr h = 0;
+    void f(char *s) {
+      if (!h) {
+        GROW(z->hint, z->hint_n, z->hint_max);
+        if (z->hint_n == z->hint_made) {
+          h = z->hint[z->hint_made++] = malloc(sizeof(*h));
+          h->coord_max = 2;
+          h->coord = NEW_ARRAY(h->coord, h->coord_max);
+        }
+        h = z->hint[z->hint_n++];
+        h->cmd = *s;
+        h->n = 0;
+        h->dlx_col = 0;
+        return;
+      }
+      int *coord = sym_get(tab, s);
+      if (!coord) die("invalid symbol: %s", s);
+      GROW(h->coord, h->n, h->coord_max);
+      F(k, 2) h->coord[h->n][k] = coord[k];
+      h->n++;
+    }
+    forall_word(s, f);
+    if (h->cmd == '>') {
+      if (h->n != 2) die("inequality must have exactly 2 fields");
+      h->cmd = '<';
+      F(k, 2) swap_int(h->coord[0] + k, h->coord[1] + k);
+    }
+  }
+}
+
+void puzzle_clear(puzzle_t z) {
+  F(i, z->hint_made) free(z->hint[i]->coord), free(z->hint[i]);
+  free(z->hint);
+  free(z->sym);
+  free(z->tab.slot);
+}
+
+// Solves using brute force: tries every permutation of every row except the
+// first. A hint only looks at the rows of its symbols, so it is checked as
+// soon as they are all permuted, and the rows that most hints mention are
+// permuted first, to check hints early.
+void brute(run_t run, int M, int N, char *sym[M][N], int hint_n,
+           hint_ptr *hint) {
+  // order[s] is the row permuted s-th, and rank[m] is when row m is.
+  // Row 0 stays put.
+  int order[M], rank[M], hits[M];
+  F(m, M) {
+    hits[m] = 0;
+    F(j, hint_n) {
+      int t = 0;
+      F(i, hint[j]->n) t |= hint[j]->coord[i][0] == m;
+      hits[m] += t;
+    }
+    order[m] = m;
+  }
+  for (int m = 2; m < M; m++) {
+    for (int k = m; k > 1 && hits[order[k-1]] < hits[order[k]]; k--) {
+      swap_int(order + k - 1, order + k);
+    }
+  }
+  F(s, M) rank[order[s]] = s;
+  // Hint j is checked once row order[last[j]] is permuted.
+  int last[hint_n];
+  F(j, hint_n) {
+    last[j] = 0;
+    F(i, hint[j]->n) if (last[j] < rank[hint[j]->coord[i][0]]) {
+      last[j] = rank[hint[j]->coord[i][0]];
+    }
+  }
+
+  // The first d entries of the first row permuted are fixed by a task, and
+  // threads share out the tasks. Each task writes its solutions to its own
+  // buffer, so they can be printed in order. With --first, a task that finds
+  // a solution lowers 'stop', and the tasks after it give up.
+  int d = M < 2 ? 0 : N < 2 ? N : 2, taskn = 1, next = 0;
+  F(i, d) taskn *= N;
+  int stop = taskn;
+  struct {
+    char *buf;
+    size_t len;
+    int64_t solutions;
+  } out[taskn];
+  void *work(void *unused) {
+    // perm[m][n] is the symbol in row m and column n. used[s] records the
+    // symbols placed so far in row order[s].
+    int perm[M][N];
+    char used[M][N];
+    // Returns nonzero if hint h is broken.
+    int check(hint_ptr h) {
+      int has(int i, int n) {
+        return perm[h->coord[i][0]][n] == h->coord[i][1];
+      }
+      int matchmax() {
+        int count = 0;
+        F(n, N) {
+          int t = 0;
+          F(i, h->n) t += has(i, n);
+          if (count < t) count = t;
+        }
+        return count;
+      }
+      int col(int i) {
+        F(n, N) if (has(i, n)) return n;
+        die("unreachable");
+      }
+
+      switch(h->cmd) {
+        case '=': return matchmax() < h->n;
+        case '!': return matchmax() > 1;
+        case '^': {
           int count = 0;
           F(n, N) {
             int t = 0;
             F(i, h->n) t += has(i, n);
-            if (count < t) count = t;
+            count += t >= 2;
           }
-          return count;
+          return count > 1;
         }
-        int col(int i) {
-          F(n, N) if (has(i, n)) return n;
-          die("unreachable");
+        case '<': return col(0) >= col(1);
+        case '>': return col(0) <= col(1);
+        case '1': return col(0) + 1 != col(1);
+        case 'A': return abs(col(0) - col(1)) != 1;
+        case 'i': {
+          int n = col(0), t = 0;
+          for (int i = 1; i < h->n; i++) t += has(i, n);
+          return t != 1;
         }
-
-        switch(h->cmd) {
-          case '=': return matchmax() < h->n;
-          case '!': return matchmax() > 1;
-          case '^': {
-            int count = 0;
-            F(n, N) {
-              int t = 0;
-              F(i, h->n) t += has(i, n);
-              count += t >= 2;
-            }
-            return count > 1;
-          }
-          case '<': return col(0) >= col(1);
-          case '>': return col(0) <= col(1);
-          case '1': return col(0) + 1 != col(1);
-          case 'A': return abs(col(0) - col(1)) != 1;
-          case 'i':
-            F(n, N) if (has(0, n)) {
-              for (int i = 1; i < h->n; i++) if (has(i, n)) return 0;
-              return 1;
-            }
-          case 'p':
-            F(n, N) {
-              if (has(0, n) && has(1, n)) return 1;
-              if (has(2, n) && has(3, n)) return 1;
-              int t = 0;
-              F(i, 4) t += has(i, n);
-              if ((t | 2) != 2) return 1;
-            }
-            return 0;
-          case 'X': {
-            int count = 0;
-            F(n, N) F(i, h->n/2) count += has(2*i, n) && has(2*i + 1, n);
-            return count > 1;
+        case 'p':
+          F(n, N) {
+            if (has(0, n) && has(1, n)) return 1;
+            if (has(2, n) && has(3, n)) return 1;
+            int t = 0;
+            F(i, 4) t += has(i, n);
+            if ((t | 2) != 2) return 1;
           }
+          return 0;
+        case 'X': {
+          int count = 0;
+          F(n, N) F(i, h->n/2) count += has(2*i, n) && has(2*i + 1, n);
+          return count > 1;
         }
-        return 0;
-      }
-      F(i, hint_n) if (check(hint[i])) return;
-      F(n, N) {
-        printf("%s", sym[0][n]);
-        F(m, M-1) printf(" %s", sym[m+1][perm[m][n]]);
-        puts("");
       }
-      return;
+      return 0;
     }
-    // Generate all permutations of row m.
-    void g(int k) {
-      if (k == N) {
-        // Base case: recurse to next row.
-        f(m + 1);
-        return;
+    int ok(int s) {
+      F(j, hint_n) if (last[j] == s && check(hint[j])) return 0;
+      return 1;
+    }
+    for (int t; (t = __atomic_fetch_add(&next, 1, __ATOMIC_RELAXED)) < taskn;) {
+      FILE *fp = run->out ? open_memstream(&out[t].buf, &out[t].len) : 0;
+      out[t].solutions = 0;
+      int done = 0;
+      // Fills in row order[s] from column k on.
+      void g(int s, int k) {
+        if (done || __atomic_load_n(&stop, __ATOMIC_RELAXED) < t) return;
+        if (s == M) {
+          out[t].solutions++;
+          if (fp) F(n, N) {
+            fprintf(fp, "%s", sym[0][n]);
+            for (int m = 1; m < M; m++) fprintf(fp, " %s", sym[m][perm[m][n]]);
+            fputc('\n', fp);
+          }
+          if ((done = first_only)) {
+            int x = stop;
+            while (t < x && !__atomic_compare_exchange_n(&stop, &x, t, 0,
+                __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+          }
+          return;
+        }
+        if (k == N) {
+          if (ok(s)) g(s + 1, 0);
+          return;
+        }
+        F(v, N) if (!used[s][v]) {
+          used[s][v] = 1;
+          perm[order[s]][k] = v;
+          g(s, k + 1);
+          used[s][v] = 0;
+        }
       }
-      for(int i = k; i < N; i++) {
-        swap_int(perm[m] + k, perm[m] + i);
-        g(k + 1);
-        swap_int(perm[m] + k, perm[m] + i);
+      F(n, N) perm[0][n] = n;
+      memset(used, 0, sizeof(used));
+      int valid = ok(0);
+      for (int i = d - 1, x = t; i >= 0; i--, x /= N) {
+        valid &= !used[1][x % N];
+        used[1][x % N] = 1;
+        perm[order[1]][i] = x % N;
       }
+      // With a single row, there is nothing to permute.
+      if (valid) g(M < 2 ? M : 1, d);
+      if (fp) fclose(fp);
     }
-    g(0);
+    return 0;
+  }
+  pthread_t thread[run->threads];
+  F(i, run->threads) pthread_create(thread + i, 0, work, 0);
+  F(i, run->threads) pthread_join(thread[i], 0);
+  int done = 0;
+  F(t, taskn) {
+    if (!done) {
+      run->solutions += out[t].solutions;
+      if (run->out) fwrite(out[t].buf, 1, out[t].len, run->out);
+    }
+    done |= first_only && out[t].solutions;
+    if (run->out) free(out[t].buf);
   }
-  f(0);
 }
 
 // Solves using DLX where each possible column corresponds to a subset in
 // the collection.
-void per_col_dlx(int M, int N, char *sym[M][N], int hint_n, hint_ptr *hint) {
-  dlx_t dlx = dlx_new();
-  // Generate all possible columns: an M-digit counter in base N.
-  // Columns that pass initial checks become the DLX-rows.
-  int a[M];  // Holds current column.
+void per_col_dlx(run_t run, int M, int N, char *sym[M][N], int hint_n,
+                 hint_ptr *hint) {
+  dlx_t dlx = run->dlx;
+  dlx_empty(dlx);
+  // Generate the possible columns: an M-digit counter in base N, skipping
+  // the digits that the hints already rule out. Columns that pass these
+  // checks become the DLX-rows.
   // The first MN DLX-columns represent the symbols. These must be covered;
   // the others are optional.
   // The symbol at row r and column c corresponds to DLX-column N*r + c.
@@ -169,132 +453,190 @@ void per_col_dlx(int M, int N, char *sym[M][N], int hint_n, hint_ptr *hint) {
   // The array dlx_a records the columns that pass the initial checks and
   // hence added as a DLX-row.
   int dlx_max = 32, (*dlx_a)[M] = NEW_ARRAY(dlx_a, dlx_max);
-  void f(int i) {
-    int has(hint_ptr h, int i) { return a[h->coord[i][0]] == h->coord[i][1]; }
-    int match(hint_ptr h) {
-      int t = 0;
-      F(i, h->n) t += has(h, i);
-      return t;
+  // Whether symbol i of hint h lies in column a.
+  int has(hint_ptr h, int *a, int i) {
+    return a[h->coord[i][0]] == h->coord[i][1];
+  }
+  int match(hint_ptr h, int *a) {
+    int t = 0;
+    F(i, h->n) t += has(h, a, i);
+    return t;
+  }
+  // Whether hint h rules out column a.
+  int anon(hint_ptr h, int *a) {
+    switch(h->cmd) {
+      case 'p': return (has(h, a, 0) && has(h, a, 1)) ||
+          (has(h, a, 2) && has(h, a, 3)) || (match(h, a) | 2) != 2;
+      case '=': return match(h, a) && match(h, a) < h->n;
+      case '1': return match(h, a) > 1 || (has(h, a, 1) && !a[0]);
+      case '<':
+      case 'A':
+      case '!': return match(h, a) > 1;
+      case 'i': return has(h, a, 0) && (match(h, a) | 2) != 2;
+      case 'X': {
+        int t = 0;
+        F(k, h->n/2) t += has(h, a, 2*k) && has(h, a, 2*k + 1);
+        return t > 1;
+      }
     }
+    return 0;
+  }
+  // A hint only looks at the rows of its symbols, so it can rule out a
+  // column as soon as the last of them is filled in: last[j] is that row
+  // for hint j. Returns whether the hints allow column a, filled in as far
+  // as row i.
+  int last[hint_n];
+  F(j, hint_n) {
+    last[j] = 0;
+    F(i, hint[j]->n) if (last[j] < hint[j]->coord[i][0]) {
+      last[j] = hint[j]->coord[i][0];
+    }
+  }
+  int ok(int *a, int i) {
+    F(j, hint_n) if (last[j] == i && anon(hint[j], a)) return 0;
+    return 1;
+  }
+
+  // Fill in the columns, pruning as we go. The first d rows of a column are
+  // fixed by a task, and threads share out the tasks. The columns allowed
+  // are kept per task, so they can be added in order.
+  int d = M < 2 ? M : 2, taskn = 1, next = 0;
+  F(i, d) taskn *= N;
+  struct {
+    int n, max;
+    int (*a)[M];
+  } out[taskn];
+  void gen(int *a, int i, int t) {
     if (i == M) {
-      // Base case: finished generating a single column. If contraints allow
-      // it, add a DLX-row representing this column, otherwise skip it.
-      // The DLX-row has a 1 in the DLX-columns corresponding to the symbols
-      // in the column.
-      int anon(hint_ptr h) {
-        switch(h->cmd) {
-          case 'p': return (has(h, 0) && has(h, 1)) ||
-              (has(h, 2) && has(h, 3)) || (match(h) | 2) != 2;
-          case '=': return match(h) == 1;
-          case '<':
-          case '1':
-          case 'A':
-          case '!': return match(h) > 1;
-          case 'i': return has(h, 0) && (match(h) | 2) != 2;
-        }
-        return 0;
+      if (out[t].n == out[t].max) {
+        out[t].max = 2*out[t].max + 16;
+        out[t].a = realloc(out[t].a, sizeof(*out[t].a) * out[t].max);
       }
-      F(i, hint_n) if (anon(hint[i])) return;
-      // No constraints immediately disqualify this column.
-      // Add a new DLX-row to represent it.
-      GROW(dlx_a, dlxM, dlx_max);
-      F(i, M) dlx_a[dlxM][i] = a[i];
-      // Set the DLX-column coresponding to each symbol.
-      F(k, M) dlx_set(dlx, dlxM, N*k + a[k]);
-      // Add optional columns for constraints that need it.
-      void assign_dlx_col(hint_ptr h) {
-        if (!h->dlx_col) {
-          h->dlx_col = dlxN;
-          F(i, N) dlx_mark_optional(dlx, dlxN++);
-        }
+      memcpy(out[t].a[out[t].n++], a, sizeof(int) * M);
+      return;
+    }
+    F(k, N) {
+      a[i] = k;
+      if (ok(a, i)) gen(a, i + 1, t);
+    }
+  }
+  void *work(void *unused) {
+    int a[M];
+    for (int t; (t = __atomic_fetch_add(&next, 1, __ATOMIC_RELAXED)) < taskn;) {
+      out[t].n = out[t].max = 0;
+      out[t].a = 0;
+      int i = 0;
+      for (int x = t; i < d; i++, x /= N) {
+        a[d - 1 - i] = x % N;
       }
-      void opthints(hint_ptr h) {
-        switch(h->cmd) {
-          case '1':
-            assign_dlx_col(h);
-            if (has(h, 0)) {
-              F(k, N) {
-                if (k == a[0] + 1) continue;
-                dlx_set(dlx, dlxM, h->dlx_col + k);
-              }
-            }
-            if (has(h, 1)) {
-              dlx_set(dlx, dlxM, h->dlx_col + a[0]);
-            }
-            break;
-          case 'A':
-            assign_dlx_col(h);
-            if (has(h, 0)) {
-              F(k, N) {
-                if (abs(k - a[0]) == 1) continue;
-                dlx_set(dlx, dlxM, h->dlx_col + k);
-              }
-            }
-            if (has(h, 1)) {
-              dlx_set(dlx, dlxM, h->dlx_col + a[0]);
-            }
-            break;
-          case '<':
-            assign_dlx_col(h);
-            if (has(h, 0)) {
-              for(int k = 0; k <= a[0]; k++) {
-                dlx_set(dlx, dlxM, h->dlx_col + k);
-              }
-            }
-            if (has(h, 1)) {
-              for(int k = a[0]; k < N; k++) {
-                dlx_set(dlx, dlxM, h->dlx_col + k);
-              }
-            }
-            break;
-          case '^':
-            if (!h->dlx_col) {
-              h->dlx_col = dlxN;
-              dlx_mark_optional(dlx, dlxN++);
+      for (i = 0; i < d && ok(a, i); i++);
+      if (i == d) gen(a, d, t);
+    }
+    return 0;
+  }
+  pthread_t thread[run->threads];
+  F(i, run->threads) pthread_create(thread + i, 0, work, 0);
+  F(i, run->threads) pthread_join(thread[i], 0);
+
+  F(t, taskn) F(c, out[t].n) {
+    int *a = out[t].a[c];
+    // No constraints immediately disqualify this column.
+    // Add a new DLX-row to represent it.
+    GROW(dlx_a, dlxM, dlx_max);
+    F(i, M) dlx_a[dlxM][i] = a[i];
+    // Set the DLX-column coresponding to each symbol.
+    F(k, M) dlx_set(dlx, dlxM, N*k + a[k]);
+    // Add optional columns for constraints that need it.
+    void assign_dlx_col(hint_ptr h) {
+      if (!h->dlx_col) {
+        h->dlx_col = dlxN;
+        F(i, N) dlx_mark_optional(dlx, dlxN++);
+      }
+    }
+    void opthints(hint_ptr h) {
+      switch(h->cmd) {
+        case '1':
+          // A single DLX-column, colored with 1 plus the position of the
+          // first symbol, as implied by either symbol.
+          if (!h->dlx_col) h->dlx_col = dlxN++;
+          if (has(h, a, 0)) dlx_set_color(dlx, dlxM, h->dlx_col, a[0] + 1);
+          if (has(h, a, 1)) dlx_set_color(dlx, dlxM, h->dlx_col, a[0]);
+          break;
+        case 'A':
+          assign_dlx_col(h);
+          if (has(h, a, 0)) {
+            F(k, N) {
+              if (abs(k - a[0]) == 1) continue;
+              dlx_set(dlx, dlxM, h->dlx_col + k);
             }
-            int count = 0;
-            F(k, h->n) count += has(h, k);
-            if (count >= 2) {
-              dlx_set(dlx, dlxM, h->dlx_col);
+          }
+          if (has(h, a, 1)) {
+            dlx_set(dlx, dlxM, h->dlx_col + a[0]);
+          }
+          break;
+        case '<':
+          assign_dlx_col(h);
+          if (has(h, a, 0)) {
+            for(int k = 0; k <= a[0]; k++) {
+              dlx_set(dlx, dlxM, h->dlx_col + k);
             }
-            break;
-          case 'X':
-            if (!h->dlx_col) {
-              h->dlx_col = dlxN;
-              dlx_mark_optional(dlx, dlxN++);
+          }
+          if (has(h, a, 1)) {
+            for(int k = a[0]; k < N; k++) {
+              dlx_set(dlx, dlxM, h->dlx_col + k);
             }
-            F(k, h->n/2) if (has(h, 2*k) && has(h, 2*k + 1)) dlx_set(dlx, dlxM, h->dlx_col);
-            break;
-        }
+          }
+          break;
+        case '^':
+          if (!h->dlx_col) {
+            h->dlx_col = dlxN;
+            dlx_mark_optional(dlx, dlxN++);
+          }
+          if (match(h, a) >= 2) {
+            dlx_set(dlx, dlxM, h->dlx_col);
+          }
+          break;
+        case 'X':
+          if (!h->dlx_col) {
+            h->dlx_col = dlxN;
+            dlx_mark_optional(dlx, dlxN++);
+          }
+          F(k, h->n/2) if (has(h, a, 2*k) && has(h, a, 2*k + 1)) {
+            dlx_set(dlx, dlxM, h->dlx_col);
+          }
+          break;
       }
-      F(i, hint_n) opthints(hint[i]);
-      dlxM++;
-      return;
-    }
-    F(k, N) {
-      a[i] = k;
-      f(i+1);
     }
+    F(i, hint_n) opthints(hint[i]);
+    dlxM++;
   }
-  f(0);
+  F(t, taskn) free(out[t].a);
+  // Symbols that no column allows still need DLX-columns, which then no
+  // DLX-row covers: make sure all M*N exist even if there are no DLX-rows.
+  dlx_set(dlx, dlxM, M*N - 1);
+  dlx_remove_row(dlx, dlxM);
 
   // Solve!
-  void pr(int row[], int n) {
-    F(i, n) {
+  int pr(int row[], int n) {
+    run->solutions++;
+    if (run->out) F(i, n) {
       F(k, M) {
-        if (k) putchar(' ');
-        printf("%s", sym[k][dlx_a[row[i]][k]]);
+        if (k) fputc(' ', run->out);
+        fputs(sym[k][dlx_a[row[i]][k]], run->out);
       }
-      putchar('\n');
+      fputc('\n', run->out);
     }
+    return first_only;
   }
-  dlx_forall_cover(dlx, pr);
-  dlx_clear(dlx);
+  dlx_forall_cover_until(dlx, pr);
+  print_stats(run, dlx);
   free(dlx_a);
 }
 
-void per_cell_dlx(int M, int N, char *sym[M][N], int hint_n, hint_ptr *hint) {
-  dlx_t dlx = dlx_new();
+void per_cell_dlx(run_t run, int M, int N, char *sym[M][N], int hint_n,
+                  hint_ptr *hint) {
+  dlx_t dlx = run->dlx;
+  dlx_empty(dlx);
   // It's easier to add all rows then subtract forbidden rows at the end than
   // to attempt a purely additive construction of the DLX-table.
   int remove_me[(M-1)*N*N];
@@ -309,117 +651,225 @@ void per_cell_dlx(int M, int N, char *sym[M][N], int hint_n, hint_ptr *hint) {
     remove_me[r] = 0;
   }
 
-  // The first row of the puzzle is a special case, complicating our code.
-  int sol[M-1][N];
-  F(m, M-1) F(n, N) sol[m][n] = -1;
-  int base = 2*(M-1)*N;
+  // Below, a symbol is given by its coordinates x = {row, column} in the
+  // input. Symbols of the first row never move, so hints involving them
+  // mostly forbid DLX-rows. Some hints call for further DLX-rows, witnesses
+  // numbered from 'rown', which are not part of the printed solution.
+  int base = 2*(M-1)*N, rown = (M-1)*N*N, dead = 0;
+  int row_of(int *x, int k) { return ((x[0] - 1)*N + x[1])*N + k; }
+  // Whether the symbol may lie in the kth column.
+  int can(int *x, int k) { return x[0] || x[1] == k; }
+  void forbid(int *x, int k) {
+    if (x[0]) remove_me[row_of(x, k)] = 1;
+    else if (x[1] == k) dead = 1;
+  }
+  // Makes witness w require the symbol to lie in the kth column, which it
+  // may. The position of a symbol is the color of a DLX-column, made the
+  // first time it is needed.
+  int pos_col[M][N];
+  F(m, M) F(n, N) pos_col[m][n] = -1;
+  void tie(int w, int *x, int k) {
+    if (!x[0]) return;
+    int *c = &pos_col[x[0]][x[1]];
+    if (*c < 0) {
+      *c = base++;
+      F(j, N) dlx_set_color(dlx, row_of(x, j), *c, j + 1);
+    }
+    dlx_set_color(dlx, w, *c, k + 1);
+  }
+  // Makes witness w require the symbol not to lie in the kth column, which
+  // it need not. Such witnesses share a DLX-column with the DLX-row placing
+  // the symbol there: they agree with each other, but not with it.
+  int not_col[M][N][N];
+  F(m, M) F(n, N) F(k, N) not_col[m][n][k] = -1;
+  void untie(int w, int *x, int k) {
+    if (!x[0]) return;
+    int *c = &not_col[x[0]][x[1]][k];
+    if (*c < 0) dlx_set(dlx, row_of(x, k), *c = base++);
+    dlx_set_color(dlx, w, *c, 1);
+  }
+  // Adds witnesses saying whether two symbols share a column, of which a
+  // solution has exactly one. Sets tog[k] to the witness that both lie in
+  // the kth column, or -1 if they cannot.
+  void pair(int *x, int *y, int tog[N]) {
+    F(k, N) tog[k] = -1;
+    if (x[0] == y[0]) return;
+    int c = base++;
+    F(k, N) if (can(x, k)) {
+      if (can(y, k)) {
+        tie(tog[k] = rown, x, k);
+        tie(rown, y, k);
+        dlx_set(dlx, rown++, c);
+      }
+      if (y[0] || y[1] != k) {
+        tie(rown, x, k);
+        untie(rown, y, k);
+        dlx_set(dlx, rown++, c);
+      }
+    }
+  }
+  // The n symbols lie in distinct columns.
+  void distinct(int (*x)[2], int n) {
+    int moving = 0;
+    F(i, n) {
+      if (x[i][0]) moving++;
+      else F(j, n) if (j != i) forbid(x[j], x[i][1]);
+    }
+    if (moving > 1) F(k, N) {
+      F(i, n) if (x[i][0]) dlx_set(dlx, row_of(x[i], k), base);
+      dlx_mark_optional(dlx, base++);
+    }
+  }
+  // The column of symbol x contains exactly one of the n symbols y.
+  void one_of(int *x, int (*y)[2], int n) {
+    int c = base++, found = 0;
+    F(i, n) {
+      int tog[N];
+      pair(x, y[i], tog);
+      F(k, N) if (tog[k] >= 0) dlx_set(dlx, tog[k], c), found = 1;
+    }
+    if (!found) dead = 1;
+  }
+  // Hints on two symbols: the first may lie in column k while the second
+  // lies in column n only if allowed(k, n).
+  void binary(int *x, int *y, int allowed(int, int)) {
+    if (!x[0]) {
+      F(n, N) if (!allowed(x[1], n)) forbid(y, n);
+    } else if (!y[0]) {
+      F(k, N) if (!allowed(k, y[1])) forbid(x, k);
+    } else F(k, N) {
+      dlx_set(dlx, row_of(x, k), base);
+      F(n, N) if (!allowed(k, n)) dlx_set(dlx, row_of(y, n), base);
+      dlx_mark_optional(dlx, base++);
+    }
+  }
+  int left(int k, int n) { return k < n; }
+  int next(int k, int n) { return k + 1 == n; }
+  int adjacent(int k, int n) { return abs(k - n) == 1; }
+
   F(i, hint_n) {
     hint_ptr h = hint[i];
-    int row_of(int x, int k) {
-      return ((h->coord[x][0] - 1)*N + h->coord[x][1])*N + k;
-    }
+    int (*x)[2] = h->coord;
     switch(h->cmd) {
       case '=': {
-        int firstrow = 0;
-        F(x, h->n) if (!h->coord[x][0]) {
-          F(y, h->n) if (x != y) {
-            sol[h->coord[y][0] - 1][h->coord[x][1]] = h->coord[y][1];
-          }
-          firstrow = 1;
+        int c = -1;
+        F(j, h->n) if (!x[j][0]) c = x[j][1];
+        if (c >= 0) {
+          F(j, h->n) F(k, N) if (k != c) forbid(x[j], k);
           break;
         }
-        if (firstrow) break;
-
-        F(x, h->n) F(k, N) {
-          dlx_set(dlx, row_of(x, k), base + k);
-          F(y, h->n) if (x != y) F(n, N) if (n != k) {
-            dlx_set(dlx, row_of(y, n), base + k);
-          }
-          F(k, N) dlx_mark_optional(dlx, base++);
-        }
+        // A single DLX-column, colored with 1 plus the position shared by
+        // the symbols.
+        F(j, h->n) F(k, N) dlx_set_color(dlx, row_of(x[j], k), base, k + 1);
+        base++;
         break;
       }
       case '!':
-        F(x, h->n) {
-          if (!h->coord[x][0]) {
-            F(y, h->n) if (x != y && h->coord[y][0]) {
-              remove_me[row_of(y, h->coord[x][1])] = 1;
-            }
-          } else F(k, N) {
-            dlx_set(dlx, row_of(x, k), base + k);
-            F(y, h->n) if (x != y && h->coord[y][0]) {
-              dlx_set(dlx, row_of(y, k), base + k);
-            }
-            F(k, N) dlx_mark_optional(dlx, base++);
-          }
-        }
+        distinct(x, h->n);
         break;
       case '<':
-        if (!h->coord[0][0]) {
-          F(k, h->coord[0][1]+1) remove_me[row_of(1, k)] = 1;
-          break;
-        }
-        if (!h->coord[1][0]) {
-          for (int k = h->coord[1][1]; k < N; k++) {
-            remove_me[row_of(0, k)] = 1;
-          }
+        binary(x[0], x[1], left);
+        break;
+      case '1':
+        if (!x[0][0] || !x[1][0]) {
+          binary(x[0], x[1], next);
           break;
         }
+        // A single DLX-column, colored with 1 plus the position of the
+        // first symbol, as implied by either symbol.
         F(k, N) {
-          dlx_set(dlx, row_of(0, k), base + k);
-          F(n, k+1) dlx_set(dlx, row_of(1, n), base + k);
+          dlx_set_color(dlx, row_of(x[0], k), base, k + 1);
+          if (k) dlx_set_color(dlx, row_of(x[1], k), base, k);
         }
-        F(k, N) dlx_mark_optional(dlx, base++);
+        remove_me[row_of(x[1], 0)] = 1;
+        base++;
         break;
-      case '1': {
-        int x = !h->coord[1][0];
-        if (!h->coord[x][0]) {
-          F(k, N) if (h->coord[x][1] - k != 1) remove_me[row_of(!x, k)] = 1; 
-          break;
-        }
-        F(k, N) {
-          dlx_set(dlx, row_of(0, k), base + k);
-          F(n, N) if (n - k != 1) dlx_set(dlx, row_of(1, n), base + k);
+      case 'A':
+        binary(x[0], x[1], adjacent);
+        break;
+      case 'i':
+        one_of(x[0], x + 1, h->n - 1);
+        break;
+      case 'p':
+        // The columns of the first two symbols are distinct, and each
+        // holds exactly one of the last two, which are distinct.
+        distinct(x, 2);
+        distinct(x + 2, 2);
+        one_of(x[0], x + 2, 2);
+        one_of(x[1], x + 2, 2);
+        break;
+      case '^': {
+        // Every pair of symbols that share a column colors a DLX-column
+        // with 1 plus its position, so there is at most one such position.
+        // Three symbols or fewer cannot crowd two columns.
+        if (h->n < 4) break;
+        int c = base++;
+        dlx_mark_optional(dlx, c);
+        F(j, h->n) F(l, j) {
+          int tog[N];
+          pair(x[j], x[l], tog);
+          F(k, N) if (tog[k] >= 0) dlx_set_color(dlx, tog[k], c, k + 1);
         }
-        F(k, N) dlx_mark_optional(dlx, base++);
         break;
       }
-      case 'A': {
-        int x = !h->coord[1][0];
-        if (!h->coord[x][0]) {
-          F(k, N) if (abs(h->coord[x][1] - k) != 1) remove_me[row_of(!x, k)] = 1; 
-          break;
+      case 'X': {
+        // The witnesses that a pair shares a column clash.
+        if (h->n < 4) break;
+        int c = base++;
+        dlx_mark_optional(dlx, c);
+        F(j, h->n/2) {
+          int tog[N];
+          pair(x[2*j], x[2*j + 1], tog);
+          F(k, N) if (tog[k] >= 0) dlx_set(dlx, tog[k], c);
         }
-        F(k, N) {
-          dlx_set(dlx, row_of(0, k), base + k);
-          F(n, N) if (abs(n - k) != 1) dlx_set(dlx, row_of(1, n), base + k);
-        }
-        F(k, N) dlx_mark_optional(dlx, base++);
         break;
       }
     }
   }
   F(r, (M-1)*N*N) if (remove_me[r]) dlx_remove_row(dlx, r);
-  F(m, M-1) F(n, N) if (sol[m][n] >= 0) dlx_pick_row(dlx, (m*N + sol[m][n])*N + n);
+  // Hints that the first row alone breaks leave a DLX-column no row covers.
+  if (dead) {
+    dlx_set(dlx, rown, base++);
+    dlx_remove_row(dlx, rown++);
+  }
   // Solve!
-  void f(int row[], int row_n) {
-    F(i, row_n) sol[row[i]/N/N][row[i]%N] = row[i]/N%N;
+  int sol[M-1][N];
+  int f(int row[], int row_n) {
+    run->solutions++;
+    if (!run->out) return first_only;
+    F(i, row_n) if (row[i] < (M-1)*N*N) sol[row[i]/N/N][row[i]%N] = row[i]/N%N;
     F(n, N) {
-      printf("%s", sym[0][n]);
-      F(m, M-1) printf(" %s", sym[m+1][sol[m][n]]);
-      putchar('\n');
+      fputs(sym[0][n], run->out);
+      F(m, M-1) fprintf(run->out, " %s", sym[m+1][sol[m][n]]);
+      fputc('\n', run->out);
     }
+    return first_only;
   }
-  dlx_forall_cover(dlx, f);
-  dlx_clear(dlx);
+  dlx_forall_cover_until(dlx, f);
+  print_stats(run, dlx);
+}
+
+// Picks per_col_dlx when its M-digit counter in base N is short enough,
+// and otherwise per_cell_dlx, whose matrix only grows as M*N*N.
+void auto_dlx(run_t run, int M, int N, char *sym[M][N], int hint_n,
+              hint_ptr *hint) {
+  double n = 1;
+  F(m, M) n *= N;
+  (n <= 1 << 16 ? per_col_dlx : per_cell_dlx)(run, M, N, sym, hint_n, hint);
 }
 
 int main(int argc, char *argv[]) {
-  void (*alg)(int M, int N, char *sym[M][N], int hint_n, hint_ptr *hint)
-      = per_col_dlx;
+  void (*alg)(run_t run, int M, int N, char *sym[M][N], int hint_n,
+              hint_ptr *hint) = auto_dlx;
+  int nproc = sysconf(_SC_NPROCESSORS_ONLN);
+  if (nproc > 1) nthreads = nproc;
   for (;;) {
     static struct option longopts[] = {
         {"alg", required_argument, 0, 'a'},
+        {"batch", no_argument, 0, 'b'},
+        {"first", no_argument, 0, '1'},
+        {"stats", no_argument, 0, 's'},
+        {"threads", required_argument, 0, 't'},
         {0, 0, 0, 0},
     };
     int c = getopt_long(argc, argv, "", longopts, 0);
@@ -432,85 +882,98 @@ int main(int argc, char *argv[]) {
           alg = per_col_dlx;
         } else if (!strcmp(optarg, "per_cell_dlx")) {
           alg = per_cell_dlx;
+        } else if (!strcmp(optarg, "auto")) {
+          alg = auto_dlx;
         } else {
           printf("Unknown algorithm\n");
           exit(0);
         }
         break;
+      case 'b':
+        batch = 1;
+        break;
+      case '1':
+        first_only = 1;
+        break;
+      case 's':
+        show_stats = 1;
+        break;
+      case 't':
+        if (atoi(optarg) < 1) die("bad thread count: %s", optarg);
+        nthreads = atoi(optarg);
+        break;
       case '?':
         exit(0);
       default: die("unreachable!");
     }
   }
-  BLT *blt = blt_new();
-  int M = 0, N = 0;
-  // Read M lines of N space-delimited fields, terminated by "%%" on a
-  // single line by itself.
-  for(;;) {
-    char *s = mallocgets();
-    if (!s) die("expected %%%%");
-    if (!strcmp(s, "%%")) {
-      free(s);
-      break;
-    }
-    int n = 0;
-    void f(char *s) {
-      int *coord = NEW_ARRAY(coord, 2);
-      coord[0] = M;
-      coord[1] = n++;
-      if (blt_put_if_absent(blt, s, coord)) die("duplicate symbol: %s", s);
-    }
-    forall_word(s, f);
-    if (!M) N = n; else if (N != n) die("line %d: wrong number of fields", M+1);
-    M++;
-    free(s);
-  }
-  char *sym[M][N];
-  void add_sym(BLT_IT *it) {
-    int *coord = it->data;
-    sym[coord[0]][coord[1]] = it->key;
+  char *input = read_all();
+  if (!batch) {
+    struct puzzle_s z = {0};
+    struct run_s run = { stdout, 0, nthreads, show_stats, dlx_new() };
+    parse(&z, input);
+    alg(&run, z.M, z.N, (char *(*)[z.N]) z.sym, z.hint_n, z.hint);
+    dlx_clear(run.dlx);
+    puzzle_clear(&z);
+    free(input);
+    return 0;
   }
-  blt_forall(blt, add_sym);
 
-  // Expect a list of constraints, one per line.
-  int hint_n = 0, hint_max = 64;
-  hint_ptr *hint = NEW_ARRAY(hint, hint_max);
-  for(char *s = 0; (s = mallocgets()); free(s)) {
-    hint_ptr h = 0;
-    void f(char *s) {
-      if (!h) {
-        h = malloc(sizeof(*h));
-        h->cmd = *s;
-        h->n = 0;
-        h->dlx_col = 0;
-        h->coord_max = 2;
-        h->coord = NEW_ARRAY(h->coord, h->coord_max);
-        GROW(hint, hint_n, hint_max);
-        hint[hint_n++] = h;
-        return;
-      }
-      BLT_IT *it = blt_get(blt, s);
-      if (!it) die("invalid symbol: %s", s);
-      int *coord = it->data;
-      GROW(h->coord, h->n, h->coord_max);
-      F(k, 2) h->coord[h->n][k] = coord[k];
-      h->n++;
-    }
-    forall_word(s, f);
-    if (h->cmd == '>') {
-      if (h->n != 2) die("inequality must have exactly 2 fields");
-      h->cmd = '<';
-      F(k, 2) swap_int(h->coord[0] + k, h->coord[1] + k);
+  // Batch mode: puzzles one after another, each ending with "%%" on a line
+  // by itself, so every other "%%" line ends a puzzle. Cut them apart there.
+  int puzzle_n = 0, puzzle_max = 64, pairs = 0;
+  char **puzzle = NEW_ARRAY(puzzle, puzzle_max);
+  puzzle[puzzle_n++] = input;
+  for (char *s = input; *s;) {
+    char *e = strchrnul(s, '\n');
+    if (e - s - (e > s && e[-1] == '\r') == 2 && !strncmp(s, "%%", 2) &&
+        !(++pairs & 1)) {
+      *s = 0;
+      GROW(puzzle, puzzle_n, puzzle_max);
+      puzzle[puzzle_n++] = *e ? e + 1 : e;
     }
+    s = *e ? e + 1 : e;
   }
+  if (!*puzzle[puzzle_n - 1]) puzzle_n--;
 
-  alg(M, N, sym, hint_n, hint);
-  F(i, hint_n) free(hint[i]->coord), free(hint[i]);
-  free(hint);
-  {
-    void f(BLT_IT *it) { free(it->data); }
-    blt_forall(blt, f);
-    blt_clear(blt);
+  // Threads take the next puzzle in turn, each with its own buffers, and
+  // count its solutions.
+  struct {
+    int64_t solutions;
+    double seconds;
+  } result[puzzle_n];
+  int next = 0;
+  void *work(void *unused) {
+    struct puzzle_s z = {0};
+    struct run_s run = { 0, 0, 1, 0, dlx_new() };
+    for (int i;
+         (i = __atomic_fetch_add(&next, 1, __ATOMIC_RELAXED)) < puzzle_n;) {
+      double t = now();
+      parse(&z, puzzle[i]);
+      run.solutions = 0;
+      alg(&run, z.M, z.N, (char *(*)[z.N]) z.sym, z.hint_n, z.hint);
+      result[i].solutions = run.solutions;
+      result[i].seconds = now() - t;
+    }
+    dlx_clear(run.dlx);
+    puzzle_clear(&z);
+    return 0;
+  }
+  double t = now();
+  pthread_t thread[nthreads];
+  F(i, nthreads) pthread_create(thread + i, 0, work, 0);
+  F(i, nthreads) pthread_join(thread[i], 0);
+  t = now() - t;
+  F(i, puzzle_n) {
+    int64_t n = result[i].solutions;
+    printf("%d: %lld solution%s, %.6fs\n", i + 1, (long long) n,
+           n == 1 ? "" : "s", result[i].seconds);
+  }
+  if (show_stats) {
+    fprintf(stderr, "%d puzzle%s, %.6fs, %.0f puzzles/s\n", puzzle_n,
+            puzzle_n == 1 ? "" : "s", t, puzzle_n / t);
   }
+  free(puzzle);
+  free(input);
   return 0;
 }
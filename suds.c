@@ -26,57 +26,380 @@
 //  4 7 . | . . 6 | . . .  
 //
 // Shows step-by-step reasoning when run with -v option.
+// Stops after the first solution when run with -1 option.
+//
+// With the -b option, solves a stream of puzzles instead, one per line of 81
+// characters, and prints the first solution of each on a line of its own, or
+// "none". The -t option spreads the work over the given number of threads.
+// Timings go to standard error.
+//
+// With the -p option, first fills in cells by constraint propagation, that
+// is, naked and hidden singles, and only searches what remains with DLX.
+//
+// Other sizes and variants:
+//
+//   -n B     boxes are BxB, so the grid is NxN where N = B*B. Digits past 9
+//            are written as letters: A = 10, B = 11, and so on.
+//   -x       each main diagonal also holds every digit once.
+//   -j FILE  jigsaw: regions are read from FILE instead of being boxes.
+//   -e FILE  extra regions, read from FILE, where no digit repeats.
+//
+// A region file has N lines of N characters. Cells sharing a character lie
+// in the same region, except '.' which marks cells in no extra region.
+#define _GNU_SOURCE
 #include <ctype.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include "dlx.h"
 
 #define F(i,n) for(int i = 0; i < n; i++)
 #define C(i,n,dir) for(cell_t i = n->dir; i != n; i = i->dir)
 
+// Box size and grid size.
+static int B = 3, N = 9;
+// Region of each cell, and extra region of each cell (-1 for none).
+static int *region, *extra, extran, diagonal;
+
+// Constraint kinds. Each kind has N*N DLX-columns, except the diagonals,
+// which have 2*N, and the extra regions, which have N per region.
+enum { CELL, ROW, COL, REGION, DIAG };
+
+static int con_col(int kind, int x, int d) {
+  if (kind <= DIAG) return kind*N*N + x*N + d;
+  return DIAG*N*N + (diagonal ? 2*N : 0) + x*N + d;
+}
+
+// The DLX-row representing digit d + 1 at row r and column c.
+static int cand(int d, int r, int c) { return (d*N + r)*N + c; }
+
+static int digit_of(int c) {
+  if (isdigit(c)) return c - '0';
+  if (N > 9 && isalpha(c)) return toupper(c) - 'A' + 10;
+  return c == '.' ? 0 : -1;
+}
+
+static int char_of(int d) { return d < 10 ? '0' + d : 'A' + d - 10; }
+
+static void die(const char *msg, const char *arg) {
+  fprintf(stderr, msg, arg);
+  fputc('\n', stderr);
+  exit(1);
+}
+
+// Reads an NxN map of characters, and numbers each distinct character other
+// than '.' in order of appearance. Returns the number of regions.
+static int read_map(const char *filename, int map[]) {
+  FILE *fp = fopen(filename, "r");
+  if (!fp) die("cannot open %s", filename);
+  int id[256], n = 0, c;  // fgetc() returns an unsigned char or EOF.
+  F(i, 256) id[i] = -1;
+  F(k, N*N) {
+    while (EOF != (c = fgetc(fp)) && isspace(c));
+    if (c == EOF) die("%s: too few cells", filename);
+    if (c == '.') map[k] = -1;
+    else map[k] = id[c] >= 0 ? id[c] : (id[c] = n++);
+  }
+  fclose(fp);
+  return n;
+}
+
+// Returns the constraint matrix of an empty grid.
+static dlx_t sudoku_dlx() {
+  dlx_t dlx = dlx_new();
+  // Rows are added in order of cand(d, r, c).
+  F(d, N) F(r, N) F(c, N) {
+    int k = r*N + c, cols[7], n = 0;
+    void con(int kind, int x) { cols[n++] = con_col(kind, x, d); }
+    cols[n++] = con_col(CELL, r, c);  // One digit per cell.
+    con(ROW, r);                // One digit per row.
+    con(COL, c);                // One digit per column.
+    con(REGION, region[k]);     // One digit per region.
+    if (diagonal) {
+      if (r == c) con(DIAG, 0);
+      if (r + c == N - 1) con(DIAG, 1);
+    }
+    if (extra[k] >= 0) con(DIAG + 1, extra[k]);
+    dlx_add_row(dlx, cols, n);
+  }
+  // An extra region smaller than the grid holds each digit at most once.
+  int size[extran];
+  F(e, extran) size[e] = 0;
+  F(k, N*N) if (extra[k] >= 0) size[extra[k]]++;
+  F(e, extran) if (size[e] < N) F(d, N) {
+    dlx_mark_optional(dlx, con_col(DIAG + 1, e, d));
+  }
+  return dlx;
+}
+
+// Units are the rows, columns, regions and so on: sets of cells where no
+// digit repeats. A unit with N cells holds every digit exactly once.
+// Cell k lies in units unit_of[k][0..unit_ofn[k]-1].
+enum { UNITS_PER_CELL = 6 };
+static int unitn, *unit, *unit_size, (*unit_of)[UNITS_PER_CELL], *unit_ofn;
+
+static void add_unit(int in_unit(int k)) {
+  unit = realloc(unit, sizeof(int) * N * (unitn + 1));
+  unit_size = realloc(unit_size, sizeof(int) * (unitn + 1));
+  int n = 0;
+  F(k, N*N) if (in_unit(k)) {
+    unit[unitn*N + n++] = k;
+    unit_of[k][unit_ofn[k]++] = unitn;
+  }
+  unit_size[unitn++] = n;
+}
+
+static void init_units() {
+  unit_of = malloc(sizeof(*unit_of) * N*N);
+  unit_ofn = malloc(sizeof(int) * N*N);
+  F(k, N*N) unit_ofn[k] = 0;
+  F(i, N) {
+    int row(int k) { return k/N == i; }
+    int col(int k) { return k%N == i; }
+    int reg(int k) { return region[k] == i; }
+    add_unit(row);
+    add_unit(col);
+    add_unit(reg);
+  }
+  if (diagonal) {
+    int diag(int k) { return k/N == k%N; }
+    int anti(int k) { return k/N + k%N == N - 1; }
+    add_unit(diag);
+    add_unit(anti);
+  }
+  F(e, extran) {
+    int ext(int k) { return extra[k] == e; }
+    add_unit(ext);
+  }
+}
+
+static int single(uint32_t x) { return x && !(x & (x - 1)); }
+
+// Candidates are bitmasks: bit d of m[k] is set if digit d + 1 may lie in
+// cell k. Repeatedly fills in naked singles (cells with one candidate) and
+// hidden singles (digits with one place to go in a unit). Returns the number
+// of cells left unsolved, or -1 if the puzzle has no solution.
+static int propagate(uint32_t m[]) {
+  uint32_t full = (1u << N) - 1;
+  int queue[N*N], qn = 0;
+  F(k, N*N) if (single(m[k])) queue[qn++] = k;
+  for (;;) {
+    // Remove each newly solved digit from the cells that see it.
+    while (qn) {
+      int k = queue[--qn];
+      F(i, unit_ofn[k]) {
+        int *u = unit + unit_of[k][i]*N;
+        F(j, unit_size[unit_of[k][i]]) if (u[j] != k && (m[u[j]] & m[k])) {
+          if (!(m[u[j]] &= ~m[k])) return -1;
+          if (single(m[u[j]])) queue[qn++] = u[j];
+        }
+      }
+    }
+    // Find hidden singles, all digits of a unit at once: 'once' collects the
+    // digits seen in at least one cell, and 'twice' in at least two.
+    F(v, unitn) if (unit_size[v] == N) {
+      int *u = unit + v*N;
+      uint32_t once = 0, twice = 0;
+      F(j, N) twice |= once & m[u[j]], once |= m[u[j]];
+      if (once != full) return -1;
+      uint32_t hidden = once & ~twice;
+      if (hidden) F(j, N) {
+        uint32_t x = m[u[j]] & hidden;
+        if (x && x != m[u[j]]) {
+          if (!single(x)) return -1;
+          m[u[j]] = x;
+          queue[qn++] = u[j];
+        }
+      }
+    }
+    if (!qn) break;
+  }
+  int n = 0;
+  F(k, N*N) n += !single(m[k]);
+  return n;
+}
+
+// Hands the candidates left by propagate() to DLX: removes the DLX-rows of
+// eliminated candidates of unsolved cells, then picks those of solved cells.
+// Returns -1 if a pick clashes.
+static int pick_candidates(dlx_t dlx, uint32_t m[]) {
+  F(k, N*N) if (!single(m[k])) F(d, N) if (!(m[k] >> d & 1)) {
+    dlx_remove_row(dlx, cand(d, k/N, k%N));
+  }
+  F(k, N*N) if (single(m[k])) {
+    if (dlx_pick_row(dlx, cand(__builtin_ctz(m[k]), k/N, k%N))) return -1;
+  }
+  return 0;
+}
+
+static double now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Solves puzzles from standard input, one per line, using the given number
+// of threads. Each thread picks the givens of a puzzle on its own copy of a
+// prebuilt matrix, then undoes them for the next puzzle. Lines are read in
+// batches; the threads share out a batch, and we print it in order.
+// If 'prop' is set, puzzles go through propagate() first, and those it
+// solves never reach DLX.
+static void batch(int nthreads, int prop) {
+  enum { BATCH = 1 << 14 };
+  // Room for a solved grid, or "none" when the grid is smaller.
+  int slot = N*N + 1 < 5 ? 5 : N*N + 1;
+  char *line[BATCH] = { 0 }, *out = malloc((size_t) BATCH * slot);
+  size_t len[BATCH] = { 0 };
+  int n, next;
+  dlx_t tmpl = sudoku_dlx(), dlx[nthreads];
+  F(i, nthreads) dlx[i] = dlx_clone(tmpl);
+  dlx_clear(tmpl);
+
+  void solve(dlx_t dlx, char *s, char *out) {
+    int mark = dlx_mark(dlx), k = 0, ok = 1;
+    uint32_t m[N*N];
+    for (; *s && k < N*N; s++) {
+      int d = digit_of(*s);
+      if (d < 0 || d > N) continue;
+      if (!prop && d && dlx_pick_row(dlx, cand(d - 1, k/N, k%N))) ok = 0;
+      m[k] = d ? 1u << (d - 1) : (1u << N) - 1;
+      out[k++] = char_of(d);
+    }
+    void f(int row[], int n) {
+      F(i, n) out[row[i]%(N*N)] = char_of(1 + row[i]/N/N);
+    }
+    out[N*N] = 0;
+    if (k == N*N && prop) {
+      int left = propagate(m);
+      if (left < 0) ok = 0;
+      F(i, N*N) if (single(m[i])) out[i] = char_of(1 + __builtin_ctz(m[i]));
+      if (!left) return;
+      if (ok && pick_candidates(dlx, m)) ok = 0;
+    }
+    if (k < N*N || !ok || !dlx_first_cover(dlx, f)) strcpy(out, "none");
+    dlx_undo(dlx, mark);
+  }
+  void *work(void *arg) {
+    dlx_t d = arg;
+    for (int i; (i = __atomic_fetch_add(&next, 1, __ATOMIC_RELAXED)) < n;) {
+      solve(d, line[i], out + i*slot);
+    }
+    return 0;
+  }
+
+  double start = now();
+  long total = 0;
+  do {
+    for (n = 0; n < BATCH && -1 != getline(line + n, len + n, stdin); n++);
+    next = 0;
+    pthread_t thread[nthreads];
+    F(i, nthreads) pthread_create(thread + i, 0, work, dlx[i]);
+    F(i, nthreads) pthread_join(thread[i], 0);
+    F(i, n) puts(out + i*slot);
+    total += n;
+  } while (n == BATCH);
+  double t = now() - start;
+  fprintf(stderr, "%ld puzzles in %.3fs: %.2f puzzles/s\n",
+      total, t, t > 0 ? total / t : 0);
+  F(i, nthreads) dlx_clear(dlx[i]);
+  F(i, BATCH) free(line[i]);
+  free(out);
+}
+
 int main(int argc, char *argv[]) {
-  int verbose = 0, opt;
-  while ((opt = getopt(argc, argv, "v")) != -1) {
-    if (opt == 'v') verbose++; else {
-      fprintf(stderr, "Usage: %s [-v]\n", *argv);
+  int verbose = 0, first = 0, batch_mode = 0, nthreads = 1, prop = 0, opt;
+  char *jigsaw = 0, *extra_file = 0;
+  while ((opt = getopt(argc, argv, "v1bt:pn:xj:e:")) != -1) {
+    if (opt == 'v') verbose++;
+    else if (opt == '1') first++;
+    else if (opt == 'b') batch_mode++;
+    else if (opt == 't' && atoi(optarg) > 0) nthreads = atoi(optarg);
+    else if (opt == 'p') prop++;
+    else if (opt == 'n' && atoi(optarg) > 0 && atoi(optarg) <= 5) {
+      B = atoi(optarg);
+      N = B*B;
+    }
+    else if (opt == 'x') diagonal++;
+    else if (opt == 'j') jigsaw = optarg;
+    else if (opt == 'e') extra_file = optarg;
+    else {
+      fprintf(stderr, "Usage: %s [-v] [-1] [-b [-t THREADS]] [-p] "
+          "[-n BOX_SIZE] [-x] [-j REGION_FILE] [-e REGION_FILE]\n", *argv);
       exit(1);
     }
   }
-  int a[9][9] = {{0}}, c;
-  F(i, 9) F(j, 9) do if (EOF == (c = getchar())) exit(1); while(
-      isdigit(c) ? a[i][j] = c - '0', 0 : c != '.');
+  region = malloc(sizeof(int) * N*N);
+  extra = malloc(sizeof(int) * N*N);
+  F(k, N*N) region[k] = k/N/B*B + k%N/B, extra[k] = -1;
+  if (jigsaw) {
+    if (N != read_map(jigsaw, region)) {
+      die("%s: need one region per digit", jigsaw);
+    }
+    int size[N];
+    F(i, N) size[i] = 0;
+    F(k, N*N) if (region[k] < 0 || ++size[region[k]] > N) {
+      die("%s: regions must each have one cell per digit", jigsaw);
+    }
+  }
+  if (extra_file) {
+    extran = read_map(extra_file, extra);
+    int size[extran];
+    F(i, extran) size[i] = 0;
+    F(k, N*N) if (extra[k] >= 0 && ++size[extra[k]] > N) {
+      die("%s: extra regions must each have at most one cell per digit",
+          extra_file);
+    }
+  }
+  init_units();
 
-  dlx_t dlx = dlx_new();
-  int nine(int a, int b, int c) { return 9*9*a + 9*b + c; }
-  F(d, 9) F(r, 9) F(c, 9) {
-    int i = 0;
-    void con(int x, int y) { dlx_set(dlx, nine(d, r, c), nine(i++, x, y)); }
-    con(r, c);            // One digit per cell.
-    con(r, d);            // One digit per row.
-    con(c, d);            // One digit per column.
-    con(r/3*3 + c/3, d);  // One digit per 3x3 region.
-  }
-  // Fill in the given digits.
-  F(r, 9) F(c, 9) if (a[r][c]) dlx_pick_row(dlx, nine(a[r][c]-1, r, c));
+  if (batch_mode) {
+    static char buf[1 << 16];
+    setvbuf(stdout, buf, _IOFBF, sizeof(buf));
+    batch(nthreads, prop);
+    return 0;
+  }
+  int a[N][N], c;
+  F(i, N) F(j, N) do if (EOF == (c = getchar())) exit(1); while(
+      (a[i][j] = digit_of(c)) < 0 || a[i][j] > N);
+
+  dlx_t dlx = sudoku_dlx();
+  if (prop) {
+    uint32_t m[N*N];
+    F(k, N*N) m[k] = a[k/N][k%N] ? 1u << (a[k/N][k%N] - 1) : (1u << N) - 1;
+    if (propagate(m) < 0 || pick_candidates(dlx, m)) exit(0);  // No solution.
+    F(k, N*N) if (single(m[k])) a[k/N][k%N] = 1 + __builtin_ctz(m[k]);
+  } else {
+    // Fill in the given digits.
+    F(r, N) F(c, N) if (a[r][c]) dlx_pick_row(dlx, cand(a[r][c]-1, r, c));
+  }
 
   // Print all solutions.
   void print_solution(int row[], int n) {
-    F(i, n) a[row[i]/9%9][row[i]%9] = row[i]/9/9 + 1;
-    F(r, 9) F(c, 9 || (putchar('\n'), 0)) putchar('0'+a[r][c]);
+    F(i, n) a[row[i]/N%N][row[i]%N] = row[i]/N/N + 1;
+    F(r, N) F(c, N || (putchar('\n'), 0)) putchar(char_of(a[r][c]));
   }
-  dlx_forall_cover(dlx, print_solution);
+  if (first) dlx_first_cover(dlx, print_solution);
+  else dlx_forall_cover(dlx, print_solution);
   if (verbose) {
     // Print reasoning.
-    int kid[9*9], n = 0, tried[9*9] = { 0 }, indent = 0;
+    int kid[N*N], n = 0, tried[N*N], indent = 0;
+    F(i, N*N) tried[i] = 0;
     void tabs() { F(i, indent) fputs("  ", stdout); }
     void con(int c) {
-      int k = c%(9*9);
-      switch(c/9/9) {
-        case 0: printf("! %d %d", k/9+1, k%9+1); break;
-        case 1: printf("%d r %d", k/9+1, k%9+1); break;
-        case 2: printf("%d c %d", k/9+1, k%9+1); break;
-        case 3: printf("%d x %d %d", k/9+1, k%9/3+1, k%9%3+1); break;
+      int k = c%(N*N);
+      switch(c/N/N) {
+        case CELL: printf("! %d %d", k/N+1, k%N+1); break;
+        case ROW: printf("%d r %d", k/N+1, k%N+1); break;
+        case COL: printf("%d c %d", k/N+1, k%N+1); break;
+        case REGION: printf("%d x %d %d", k/N+1, k%N/B+1, k%N%B+1); break;
+        default:
+          k = c - DIAG*N*N;
+          if (diagonal && k < 2*N) printf("%d d %d", k/N+1, k%N+1);
+          else printf("%d e %d", (k - (diagonal ? 2*N : 0))/N+1, k%N+1);
       }
     }
     void cover(int c, int s, int r) {
@@ -86,7 +409,7 @@ int main(int argc, char *argv[]) {
       }
       tabs(), con(c);
       if (s == 1) printf(" =>"); else printf(" guess [%d/%d]:", tried[n]+1, s);
-      printf(" %d @ %d %d\n", r/9/9+1, r/9%9+1, r%9+1);
+      printf(" %d @ %d %d\n", r/N/N+1, r/N%N+1, r%N+1);
       n++;
     }
     void uncover() {
@@ -102,5 +425,11 @@ int main(int argc, char *argv[]) {
     dlx_solve(dlx, cover, uncover, found, stuck);
   }
   dlx_clear(dlx);
+  free(region);
+  free(extra);
+  free(unit);
+  free(unit_size);
+  free(unit_of);
+  free(unit_ofn);
   return 0;
 }